@@ -0,0 +1,419 @@
+// Times SimbaDecoder::decode(), an unchecked reference walk and
+// SimbaDecoder::decodeBatch() on a generated capture.
+// Usage: decode_bench [pcap file path] [packets] [rounds]
+
+#include "../include/pcap_parser.hpp"
+#include "../include/simba_decoder.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <arpa/inet.h> // For htons and htonl
+
+namespace {
+
+// Ports of the incremental and the snapshot feed in the generated capture
+constexpr uint16_t INCREMENTAL_PORT = 20081;
+constexpr uint16_t SNAPSHOT_PORT = 20082;
+
+// Every tenth packet is a snapshot, the others carry 1 to 4 incremental
+// messages, half order updates and half execution pairs
+constexpr uint64_t SNAPSHOT_EVERY = 10;
+
+template<typename T>
+void appendBytes(std::vector<uint8_t>& out, const T& value, size_t size)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+// One of the three securities of the generated capture
+int32_t randomSecurity(std::mt19937& rng)
+{
+    return 100 * (1 + static_cast<int32_t>(rng() % 3));
+}
+
+void appendSBEHeader(std::vector<uint8_t>& out,
+                     uint16_t blockLength,
+                     uint16_t templateId)
+{
+    const simba::SBEHeader header{ blockLength, templateId, 19780, 4 };
+    appendBytes(out, header, simba::SBEHeader::SIZE);
+}
+
+// SIMBA payload of one incremental packet
+std::vector<uint8_t> incrementalPayload(std::mt19937& rng,
+                                        uint32_t seqNum,
+                                        uint64_t timeNs,
+                                        int64_t& tradeId)
+{
+    std::vector<uint8_t> body;
+    const int messages = 1 + static_cast<int>(rng() % 4);
+    for (int i = 0; i < messages; ++i) {
+        const int32_t securityId = randomSecurity(rng);
+        const int64_t price = 9000000 + rng() % 2000000;
+        const int64_t size = 1 + static_cast<int64_t>(rng() % 100);
+        if (rng() % 2 == 0) {
+            simba::OrderUpdate update{};
+            update.md_entry_id = seqNum * 10 + i;
+            update.md_entry_px.mantissa = price;
+            update.md_entry_size = size;
+            update.md_flags = simba::MDFlagsSet::Day;
+            update.security_id = securityId;
+            update.rpt_seq = seqNum;
+            update.md_update_action = simba::MDUpdateAction::New;
+            update.md_entry_type = simba::MDEntryType::Bid;
+            appendSBEHeader(body,
+                            simba::OrderUpdate::SIZE,
+                            simba::OrderUpdate::TEMPLATE_ID);
+            appendBytes(body, update, simba::OrderUpdate::SIZE);
+            continue;
+        }
+
+        ++tradeId;
+        for (const auto side :
+             { simba::MDEntryType::Bid, simba::MDEntryType::Offer }) {
+            simba::OrderExecution execution{};
+            execution.md_entry_id = seqNum * 10 + i;
+            execution.md_entry_px.mantissa = INT64_MAX;
+            execution.last_px.mantissa = price;
+            execution.last_qty = size;
+            execution.trade_id = tradeId;
+            execution.md_flags = simba::MDFlagsSet::Day;
+            execution.security_id = securityId;
+            execution.rpt_seq = seqNum;
+            execution.md_update_action = simba::MDUpdateAction::Change;
+            execution.md_entry_type = side;
+            appendSBEHeader(body,
+                            simba::OrderExecution::SIZE,
+                            simba::OrderExecution::TEMPLATE_ID);
+            appendBytes(body, execution, simba::OrderExecution::SIZE);
+        }
+    }
+
+    std::vector<uint8_t> payload;
+    const simba::MarketDataPacketHeader header{
+        seqNum,
+        static_cast<uint16_t>(simba::MarketDataPacketHeader::SIZE +
+                              simba::IncrementalPacketHeader::SIZE +
+                              body.size()),
+        0x8,
+        timeNs
+    };
+    appendBytes(payload, header, simba::MarketDataPacketHeader::SIZE);
+    const simba::IncrementalPacketHeader incremental{ timeNs, 7 };
+    appendBytes(payload, incremental, simba::IncrementalPacketHeader::SIZE);
+    payload.insert(payload.end(), body.begin(), body.end());
+    return payload;
+}
+
+// SIMBA payload of one snapshot packet with 1 to 5 entries
+std::vector<uint8_t> snapshotPayload(std::mt19937& rng,
+                                     uint32_t seqNum,
+                                     uint64_t timeNs)
+{
+    const uint8_t entries = static_cast<uint8_t>(1 + rng() % 5);
+
+    std::vector<uint8_t> body;
+    appendSBEHeader(body,
+                    simba::OrderBookSnapshot::BLOCK_LENGTH,
+                    simba::OrderBookSnapshot::TEMPLATE_ID);
+    const int32_t securityId = randomSecurity(rng);
+    appendBytes(body, securityId, sizeof(securityId));
+    appendBytes(body, seqNum, sizeof(seqNum));
+    appendBytes(body, seqNum, sizeof(seqNum));
+    const uint32_t sessionId = 7;
+    appendBytes(body, sessionId, sizeof(sessionId));
+    const simba::GroupSize group{
+        static_cast<uint16_t>(simba::OrderBookSnapshot::Entry::SIZE), entries
+    };
+    appendBytes(body, group, simba::GroupSize::SIZE);
+    for (uint8_t i = 0; i < entries; ++i) {
+        simba::OrderBookSnapshot::Entry entry{};
+        entry.md_entry_id = i;
+        entry.transact_time = timeNs;
+        entry.md_entry_px.mantissa = 10000000 + i * 1000;
+        entry.md_entry_size = 10;
+        entry.md_entry_type =
+          i % 2 ? simba::MDEntryType::Bid : simba::MDEntryType::Offer;
+        appendBytes(body, entry, simba::OrderBookSnapshot::Entry::SIZE);
+    }
+
+    std::vector<uint8_t> payload;
+    const simba::MarketDataPacketHeader header{
+        seqNum,
+        static_cast<uint16_t>(simba::MarketDataPacketHeader::SIZE +
+                              body.size()),
+        0,
+        timeNs
+    };
+    appendBytes(payload, header, simba::MarketDataPacketHeader::SIZE);
+    payload.insert(payload.end(), body.begin(), body.end());
+    return payload;
+}
+
+// Write a pcap file holding the payloads as UDP multicast datagrams
+void writeCapture(const std::string& path, uint64_t packets)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Error: Could not open " + path);
+    }
+
+    const pcap::PcapGlobalHeader globalHeader{
+        pcap::PcapGlobalHeader::MAGIC_MICROSECONDS, 2, 4, 0, 0, 65535, 1
+    };
+    file.write(reinterpret_cast<const char*>(&globalHeader),
+               pcap::PcapGlobalHeader::SIZE);
+
+    std::mt19937 rng(1);
+    uint64_t timeUs = 1700000000ULL * 1000000;
+    uint32_t incrementalSeqNum = 0;
+    uint32_t snapshotSeqNum = 0;
+    int64_t tradeId = 1000;
+    for (uint64_t i = 0; i < packets; ++i) {
+        timeUs += 50 + rng() % 3000;
+        const bool snapshot = i % SNAPSHOT_EVERY == SNAPSHOT_EVERY - 1;
+        const std::vector<uint8_t> payload =
+          snapshot ? snapshotPayload(rng, ++snapshotSeqNum, timeUs * 1000)
+                   : incrementalPayload(
+                       rng, ++incrementalSeqNum, timeUs * 1000, tradeId);
+
+        const size_t udpLength = pcap::UDPHeader::SIZE + payload.size();
+        const size_t ipLength = pcap::IPv4Header::BASE_HEADER_SIZE + udpLength;
+        const uint32_t length =
+          static_cast<uint32_t>(pcap::EthernetHeader::SIZE + ipLength);
+        const pcap::PcapPacketHeader packetHeader{
+            static_cast<uint32_t>(timeUs / 1000000),
+            static_cast<uint32_t>(timeUs % 1000000),
+            length,
+            length
+        };
+        pcap::EthernetHeader ethernetHeader{};
+        ethernetHeader.etherType = htons(0x0800);
+        pcap::IPv4Header ipHeader{};
+        ipHeader.versionAndHeaderLength = 0x45;
+        ipHeader.totalLength = htons(static_cast<uint16_t>(ipLength));
+        ipHeader.ttl = 64;
+        ipHeader.protocol = 17;
+        ipHeader.sourceAddress = htonl(0x0a000001);
+        ipHeader.destinationAddress = htonl(0xefc30101);
+        const pcap::UDPHeader udpHeader{
+            htons(5000),
+            htons(snapshot ? SNAPSHOT_PORT : INCREMENTAL_PORT),
+            htons(static_cast<uint16_t>(udpLength)),
+            0
+        };
+
+        file.write(reinterpret_cast<const char*>(&packetHeader),
+                   pcap::PcapPacketHeader::SIZE);
+        file.write(reinterpret_cast<const char*>(&ethernetHeader),
+                   pcap::EthernetHeader::SIZE);
+        file.write(reinterpret_cast<const char*>(&ipHeader),
+                   pcap::IPv4Header::BASE_HEADER_SIZE);
+        file.write(reinterpret_cast<const char*>(&udpHeader),
+                   pcap::UDPHeader::SIZE);
+        file.write(reinterpret_cast<const char*>(payload.data()),
+                   payload.size());
+    }
+    if (!file) {
+        throw std::runtime_error("Error: Could not write " + path);
+    }
+}
+
+// The decoder's walk before bounds checking was added, kept as the baseline
+// the checked decode() is measured against. Trusts every length in the
+// packet, so it is only safe on the generated capture.
+class UncheckedDecoder
+{
+public:
+    explicit UncheckedDecoder(const std::vector<uint8_t>& packetData)
+      : data(packetData)
+    {
+    }
+
+    void decode()
+    {
+        size_t offset = 0;
+        simba::MarketDataPacketHeader header;
+        std::memcpy(&header, data.data(), simba::MarketDataPacketHeader::SIZE);
+        offset += simba::MarketDataPacketHeader::SIZE;
+
+        if (header.IsIncremental()) {
+            simba::IncrementalPacketHeader incremental;
+            std::memcpy(&incremental,
+                        data.data() + offset,
+                        simba::IncrementalPacketHeader::SIZE);
+            offset += simba::IncrementalPacketHeader::SIZE;
+        }
+
+        while (offset < data.size()) {
+            simba::SBEHeader sbe;
+            std::memcpy(&sbe, data.data() + offset, simba::SBEHeader::SIZE);
+            offset += simba::SBEHeader::SIZE;
+
+            switch (sbe.template_id) {
+                case simba::OrderUpdate::TEMPLATE_ID: {
+                    simba::OrderUpdate update;
+                    std::memcpy(&update,
+                                data.data() + offset,
+                                simba::OrderUpdate::SIZE);
+                    orderUpdates.emplace_back(update);
+                    offset += simba::OrderUpdate::SIZE;
+                    break;
+                }
+                case simba::OrderExecution::TEMPLATE_ID: {
+                    simba::OrderExecution execution;
+                    std::memcpy(&execution,
+                                data.data() + offset,
+                                simba::OrderExecution::SIZE);
+                    orderExecutions.emplace_back(execution);
+                    offset += simba::OrderExecution::SIZE;
+                    break;
+                }
+                case simba::OrderBookSnapshot::TEMPLATE_ID: {
+                    simba::OrderBookSnapshot snapshot;
+                    std::memcpy(&snapshot.security_id,
+                                data.data() + offset,
+                                simba::OrderBookSnapshot::SIZE);
+                    offset += simba::OrderBookSnapshot::SIZE;
+                    snapshot.entries.resize(
+                      snapshot.no_md_entries.num_in_group);
+                    for (auto& entry : snapshot.entries) {
+                        std::memcpy(&entry,
+                                    data.data() + offset,
+                                    simba::OrderBookSnapshot::Entry::SIZE);
+                        offset += simba::OrderBookSnapshot::Entry::SIZE;
+                    }
+                    orderBookSnapshots.emplace_back(std::move(snapshot));
+                    break;
+                }
+                default:
+                    offset += sbe.block_length;
+                    break;
+            }
+        }
+    }
+
+    uint64_t messages() const noexcept
+    {
+        return orderUpdates.size() + orderExecutions.size() +
+               orderBookSnapshots.size();
+    }
+
+private:
+    const std::vector<uint8_t>& data;
+    std::vector<simba::OrderUpdate> orderUpdates;
+    std::vector<simba::OrderExecution> orderExecutions;
+    std::vector<simba::OrderBookSnapshot> orderBookSnapshots;
+};
+
+// Nanoseconds per packet of the fastest of the rounds
+template<typename Function>
+double bestNsPerPacket(int rounds, size_t packets, Function function)
+{
+    double best = 0;
+    for (int round = 0; round < rounds; ++round) {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        const double elapsed = std::chrono::duration<double, std::nano>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+        if (round == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best / packets;
+}
+
+} // namespace
+
+int main(const int argc, const char* argv[])
+{
+    const std::string path = argc > 1 ? argv[1] : "bench.pcap";
+    const uint64_t packetCount =
+      argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 300000;
+    const int rounds = argc > 3 ? std::atoi(argv[3]) : 5;
+    if (packetCount == 0 || rounds <= 0) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [pcap file path] [packets] [rounds]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        writeCapture(path, packetCount);
+
+        // Load the payloads so that only decoding is timed
+        std::vector<std::vector<uint8_t>> payloads;
+        pcap::PcapParser parser(path);
+        parser.open();
+        pcap::PcapPacket packet;
+        while (parser.next(packet)) {
+            payloads.push_back(packet.data);
+        }
+        std::vector<simba::PacketView> views;
+        views.reserve(payloads.size());
+        for (const auto& payload : payloads) {
+            views.push_back({ payload.data(), payload.size(), 0, 0, 0 });
+        }
+
+        // The checksums keep the decoded results alive and show that all
+        // paths saw the same messages
+        uint64_t decodeMessages = 0;
+        const double decodeNs = bestNsPerPacket(rounds, views.size(), [&]() {
+            decodeMessages = 0;
+            for (const auto& payload : payloads) {
+                simba::SimbaDecoder decoder(payload);
+                decoder.decode();
+                decodeMessages += decoder.getStats().messages;
+            }
+        });
+
+        uint64_t uncheckedMessages = 0;
+        const double uncheckedNs =
+          bestNsPerPacket(rounds, views.size(), [&]() {
+              uncheckedMessages = 0;
+              for (const auto& payload : payloads) {
+                  UncheckedDecoder decoder(payload);
+                  decoder.decode();
+                  uncheckedMessages += decoder.messages();
+              }
+          });
+
+        std::vector<simba::OrderUpdateRecord> updates(1 << 16);
+        std::vector<simba::OrderExecutionRecord> executions(1 << 16);
+        std::vector<simba::SnapshotEntryRecord> entries(1 << 16);
+        uint64_t batchMessages = 0;
+        const double batchNs = bestNsPerPacket(rounds, views.size(), [&]() {
+            simba::DecodeBuffers buffers{ updates.data(),    updates.size(),
+                                          0,                 executions.data(),
+                                          executions.size(), 0,
+                                          entries.data(),    entries.size(),
+                                          0,                 {} };
+            size_t done = 0;
+            while (done < views.size()) {
+                done += simba::SimbaDecoder::decodeBatch(
+                  views.data() + done, views.size() - done, buffers);
+            }
+            batchMessages = buffers.stats.messages;
+        });
+
+        std::cout << views.size() << " packets, best of " << rounds
+                  << " rounds" << std::endl;
+        std::cout << "decode():      " << decodeNs << " ns/packet, "
+                  << decodeMessages << " messages" << std::endl;
+        std::cout << "unchecked:     " << uncheckedNs << " ns/packet, "
+                  << uncheckedMessages << " messages" << std::endl;
+        std::cout << "decodeBatch(): " << batchNs << " ns/packet, "
+                  << batchMessages << " messages" << std::endl;
+    } catch (const std::exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+#ifndef BAR_AGGREGATOR_HPP
+#define BAR_AGGREGATOR_HPP
+
+#include "simba_messages.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace simba {
+
+// OHLCV bar for one instrument and interval. Prices are Decimal5 mantissas.
+struct Bar
+{
+    int32_t security_id;
+    uint64_t start_time; // Interval start, nanoseconds since the epoch
+    int64_t open;
+    int64_t high;
+    int64_t low;
+    int64_t close;
+    int64_t volume;
+    Notional notional; // Sum of last_px.mantissa * last_qty
+    uint32_t trades;
+    int64_t first_trade_id;
+    int64_t last_trade_id;
+
+    // Volume weighted average price as a Decimal5 mantissa, see vwap()
+    int64_t vwap() const noexcept;
+};
+
+// Volume weighted average price of a notional as a Decimal5 mantissa,
+// rounded half away from zero, 0 without volume
+int64_t vwap(Notional notional, int64_t volume) noexcept;
+
+// Corrupt captures can carry absurd quantities, so volume and notional sums
+// saturate instead of overflowing
+int64_t saturatingAdd(int64_t a, int64_t b) noexcept;
+Notional saturatingAdd(Notional a, Notional b) noexcept;
+
+// Format a Decimal5 mantissa exactly, e.g. 12345678 -> "123.45678"
+std::string formatDecimal5(int64_t mantissa);
+
+// Streaming aggregation of OrderExecution messages into per-instrument bars.
+// Executions are sharded by security_id across worker threads so that each
+// instrument is always handled by the same worker, in arrival order.
+class BarAggregator
+{
+public:
+    // A worker count of 0 picks one per hardware thread
+    explicit BarAggregator(uint64_t intervalNs, unsigned workers = 0);
+    ~BarAggregator();
+
+    BarAggregator(const BarAggregator&) = delete;
+    BarAggregator& operator=(const BarAggregator&) = delete;
+
+    // Queue an execution, timeNs selects the bar it is aggregated into
+    void add(const OrderExecution& execution, uint64_t timeNs);
+
+    // Process everything queued so far, stop the workers and close the open
+    // bars
+    void finish();
+
+    // Wait until the workers have processed everything queued so far, then
+    // write the completed bars as CSV, ordered by security_id and start
+    // time, and release them. After finish() this writes every bar.
+    void writeCompleted(std::ostream& out);
+
+    // Wait until the workers have processed everything queued so far and
+    // serialize the aggregation state
+    void saveState(std::vector<uint8_t>& state);
+
+    // Restore state written by saveState(), call before the first add().
+    // The worker count may differ from the run that saved it.
+    void restoreState(const std::vector<uint8_t>& state);
+
+    // Bars not yet written by writeCompleted(), ordered by security_id and
+    // start time, call after finish()
+    std::vector<Bar> bars() const;
+
+    // Write the bars as CSV
+    void writeCSV(std::ostream& out) const;
+
+    // Write the CSV column names
+    static void writeCSVHeader(std::ostream& out);
+
+private:
+    // Compact execution record handed to the workers
+    struct Trade
+    {
+        int32_t security_id;
+        int64_t price;
+        int64_t quantity;
+        int64_t trade_id;
+        uint64_t time;
+    };
+
+    // Aggregation state of one instrument
+    struct Instrument
+    {
+        int64_t lastTradeId;
+        bool hasBar;
+        Bar current;
+        std::vector<Bar> completed;
+    };
+
+    // Queue and state owned by one worker thread
+    struct Shard
+    {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::condition_variable drained;
+        std::deque<std::vector<Trade>> queue;
+        bool busy = false; // Worker is processing a batch
+        bool stopping = false;
+
+        std::vector<Trade> pending; // Producer side batch
+        std::unordered_map<int32_t, Instrument> instruments;
+        std::thread thread;
+    };
+
+    uint64_t intervalNs;
+    bool finished;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    void publish(Shard& shard);
+    void drain();
+    void run(Shard& shard);
+    void aggregate(Shard& shard, const Trade& trade);
+};
+
+} // namespace simba
+
+#endif // BAR_AGGREGATOR_HPP
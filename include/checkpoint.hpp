@@ -0,0 +1,131 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include "pcap_messages.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#pragma pack(push, 1) // On-disk layout, no padding
+
+namespace pcap {
+
+// Run that wrote a checkpoint; a checkpoint only resumes the same mode
+enum class CheckpointMode : uint8_t
+{
+    Json = 1,
+    Bars = 2,
+};
+
+// Identifies the capture a checkpoint was taken on
+struct CaptureIdentity
+{
+    uint64_t size;     // File size in bytes
+    int64_t mtime_ns;  // Modification time, nanoseconds since the epoch
+    PcapGlobalHeader global_header;
+
+    static constexpr size_t SIZE =
+      sizeof(size) + sizeof(mtime_ns) + PcapGlobalHeader::SIZE;
+
+    // Identity of the capture at path, throws if it cannot be read
+    static CaptureIdentity of(const std::string& path,
+                              const PcapGlobalHeader& globalHeader);
+
+    bool operator==(const CaptureIdentity& other) const noexcept;
+};
+static_assert(CaptureIdentity::SIZE == 40, "CaptureIdentity size mismatch!");
+
+// Fixed-size header at the start of a checkpoint file
+struct CheckpointHeader
+{
+    static constexpr uint64_t MAGIC = 0x31504B4341424D53; // "SMBACKP1"
+    static constexpr uint32_t VERSION = 2;
+
+    uint64_t magic;
+    uint32_t version;
+    CheckpointMode mode;
+    CaptureIdentity capture;
+    uint64_t pcap_offset;   // Offset of the next packet to read
+    uint64_t output_offset; // Bytes of output written so far
+    uint64_t packets;       // Packets processed so far
+    uint32_t feed_count;    // Number of FeedSequence records that follow
+    uint64_t state_size;    // Size of the engine state that follows them
+
+    static constexpr size_t SIZE =
+      sizeof(magic) + sizeof(version) + sizeof(mode) + CaptureIdentity::SIZE +
+      sizeof(pcap_offset) + sizeof(output_offset) + sizeof(packets) +
+      sizeof(feed_count) + sizeof(state_size);
+};
+static_assert(CheckpointHeader::SIZE == 89, "CheckpointHeader size mismatch!");
+
+// Last SIMBA msg_seq_num seen on one feed (destination address and port)
+struct FeedSequence
+{
+    uint32_t address; // Network byte order
+    uint16_t port;    // Network byte order
+    uint32_t msg_seq_num;
+
+    static constexpr size_t SIZE =
+      sizeof(address) + sizeof(port) + sizeof(msg_seq_num);
+};
+static_assert(FeedSequence::SIZE == 10, "FeedSequence size mismatch!");
+
+#pragma pack(pop)
+
+// Where to write checkpoints and where to resume from
+struct CheckpointOptions
+{
+    std::string path;            // Checkpoint file, empty disables them
+    uint64_t interval = 1000000; // Packets between checkpoints
+    std::string resumePath;      // Checkpoint to resume from, empty starts over
+
+    bool due(uint64_t packets) const noexcept
+    {
+        return !path.empty() && interval > 0 && packets % interval == 0;
+    }
+};
+
+// Decode progress that allows a run to continue where it stopped
+struct Checkpoint
+{
+    CheckpointMode mode = CheckpointMode::Json;
+    CaptureIdentity capture{};
+    uint64_t pcapOffset = 0;
+    uint64_t outputOffset = 0;
+    uint64_t packets = 0;
+    std::vector<FeedSequence> feeds;
+
+    // Opaque state of a stateful engine (e.g. aggregated bars)
+    std::vector<uint8_t> engineState;
+
+    // Feeds loaded from a checkpoint whose next packet is not checked yet
+    std::vector<bool> unchecked;
+
+    // Remember the SIMBA sequence number of the packet's feed. After a
+    // resume, warn if the first packet of a checkpointed feed does not
+    // continue its sequence, i.e. the capture has a gap there or the
+    // checkpoint does not match its pcap offset.
+    void recordPacket(const PcapPacket& packet);
+
+    // Write the checkpoint, replacing the file atomically and durably
+    void save(const std::string& path) const;
+
+    // Read a checkpoint written by save(), throws if it is invalid
+    static Checkpoint load(const std::string& path);
+
+    // Throw unless the checkpoint was written by the same mode on the same
+    // capture and its offsets fit the capture and the current output file
+    void validate(CheckpointMode expectedMode,
+                  const CaptureIdentity& expectedCapture,
+                  const std::string& outputPath) const;
+
+    // Open the output for appending after dropping anything written after
+    // the checkpoint was taken
+    void reopenOutput(const std::string& outputPath, std::ofstream& out) const;
+};
+
+} // namespace pcap
+
+#endif // CHECKPOINT_HPP
@@ -13,6 +13,9 @@ namespace pcap {
 // Struct for the pcap global header
 struct PcapGlobalHeader
 {
+    static constexpr uint32_t MAGIC_MICROSECONDS = 0xa1b2c3d4;
+    static constexpr uint32_t MAGIC_NANOSECONDS = 0xa1b23c4d;
+
     uint32_t magic_number;
     uint16_t version_major;
     uint16_t version_minor;
@@ -31,7 +34,7 @@ static_assert(PcapGlobalHeader::SIZE == 24, "PcapGlobalHeader size mismatch!");
 struct PcapPacketHeader
 {
     uint32_t ts_sec;   // Timestamp seconds
-    uint32_t ts_usec;  // Timestamp microseconds
+    uint32_t ts_usec;  // Timestamp microseconds (nanoseconds, see magic)
     uint32_t incl_len; // Number of octets of packet saved in file
     uint32_t orig_len; // Actual length of the packet
 
@@ -1,8 +1,11 @@
 #ifndef PCAP_PARSER_HPP
 #define PCAP_PARSER_HPP
 
+#include "checkpoint.hpp"
 #include "pcap_messages.hpp"
+#include "simba_decoder.hpp"
 #include <fstream>
+#include <string>
 
 namespace pcap {
 
@@ -10,26 +13,58 @@ namespace pcap {
 class PcapParser
 {
 public:
+    explicit PcapParser(const std::string& filename);
     explicit PcapParser(const std::string& filename,
                         const std::string& outputFile);
-    void parse();
+
+    // Decode every packet and write the result as JSON to the output file,
+    // optionally checkpointing and resuming from a checkpoint
+    void parse(const CheckpointOptions& checkpointOptions = {});
+
+    // Open the pcap file and read its global header
+    void open();
+
+    // Read the next packet, returns false once the end of file is reached.
+    // The packet's payload storage is reused across calls.
+    bool next(PcapPacket& packet);
+
+    // File offset of the next packet, and repositioning to such an offset
+    uint64_t tell();
+    void seek(uint64_t offset);
+
+    // Packet capture time in nanoseconds, honouring the file's resolution
+    uint64_t timestampNs(const PcapPacketHeader& header) const noexcept;
+
+    const PcapGlobalHeader& getGlobalHeader() const noexcept
+    {
+        return globalHeader;
+    }
+
+    // Decode counters accumulated by parse()
+    const simba::DecodeStats& getDecodeStats() const noexcept
+    {
+        return decodeStats;
+    }
 
 private:
     std::string filename;
     std::string outputFile;
 
+    static constexpr size_t READ_BUFFER_SIZE = 1 << 20;
+    std::vector<char> readBuffer;
+    std::ifstream pcapFile;
     PcapGlobalHeader globalHeader;
+    simba::DecodeStats decodeStats;
 
     // Methods to parse different parts of the packet
     static PcapGlobalHeader parseGlobalHeader(std::ifstream& file);
-    static PcapPacket parsePacket(std::ifstream& file);
+    static void parsePacket(std::ifstream& file, PcapPacket& packet);
     static EthernetHeader parseEthernetHeader(std::ifstream& file);
     static IPv4Header parseIPv4Header(std::ifstream& file);
     static UDPHeader parseUDPHeader(std::ifstream& file);
 
     // Methods to process and display packet information
-    static void saveDecodedPacket(const PcapPacket& packet,
-                                  std::ofstream& outFile);
+    void saveDecodedPacket(const PcapPacket& packet, std::ofstream& outFile);
 };
 
 } // namespace pcap
@@ -0,0 +1,101 @@
+#ifndef PCAP_REPLAYER_HPP
+#define PCAP_REPLAYER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pcap {
+
+// Multicast group (or unicast host) that replayed payloads are sent to
+struct ReplayEndpoint
+{
+    uint32_t address; // IPv4 address, network byte order
+    uint16_t port;    // UDP port, network byte order
+
+    // Parse an "a.b.c.d:port" string, throws on malformed input
+    static ReplayEndpoint parse(const std::string& text);
+
+    // Parse an "a.b.c.d" address into network byte order, throws on
+    // malformed input
+    static uint32_t parseAddress(const std::string& text);
+};
+
+// Replay settings
+struct ReplayConfig
+{
+    // Playback speed relative to capture timing, 0 replays at maximum rate
+    double speed = 1.0;
+
+    // Destinations for the replayed feeds. Each distinct captured
+    // destination is mapped to groups[i % groups.size()] in order of first
+    // appearance; when empty the captured destinations are reused as-is.
+    std::vector<ReplayEndpoint> groups;
+
+    uint32_t interfaceAddress = 0; // Outgoing multicast interface (any)
+    int ttl = 1;                   // Multicast TTL
+    bool loopback = true;          // Deliver multicast to local listeners
+    size_t batchSize = 64;         // Datagrams per sendmmsg call
+    unsigned loops = 1;            // Number of passes over the capture
+
+    // Sleep through long gaps instead of busy-spinning all the way, which
+    // frees the core at the cost of pacing lateness
+    bool sleep = false;
+};
+
+// Results of a replay run
+struct ReplayStats
+{
+    uint64_t packets = 0;    // Datagrams sent
+    uint64_t bytes = 0;      // Payload bytes sent
+    uint64_t sendErrors = 0; // Datagrams dropped after a send error
+    double elapsedSeconds = 0;
+
+    // Pacing lateness: time a datagram is handed to the send batch minus its
+    // scheduled time. The batch is sent as soon as no further datagram is
+    // due, so the sendmmsg call itself is not included.
+    uint64_t meanLatenessNs = 0;
+    uint64_t p99LatenessNs = 0;
+    uint64_t maxLatenessNs = 0;
+
+    double packetsPerSecond() const noexcept
+    {
+        return elapsedSeconds > 0 ? packets / elapsedSeconds : 0;
+    }
+};
+
+// Class to replay the UDP payloads (SIMBA data) of a pcap file
+class PcapReplayer
+{
+public:
+    explicit PcapReplayer(const std::string& filename,
+                          const ReplayConfig& config);
+
+    // Load the capture into memory and send it, blocking until done
+    ReplayStats replay();
+
+private:
+    // A captured datagram stored in the contiguous payload buffer
+    struct Frame
+    {
+        uint64_t timestampNs; // Capture time relative to the first packet
+        size_t offset;        // Offset of the payload in the buffer
+        uint32_t length;      // Payload length
+        uint32_t destination; // Index into destinations
+    };
+
+    std::string filename;
+    ReplayConfig config;
+
+    std::vector<uint8_t> payloads;
+    std::vector<Frame> frames;
+    std::vector<ReplayEndpoint> destinations;
+
+    void load();
+    int openSocket() const;
+};
+
+} // namespace pcap
+
+#endif // PCAP_REPLAYER_HPP
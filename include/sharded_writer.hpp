@@ -0,0 +1,116 @@
+#ifndef SHARDED_WRITER_HPP
+#define SHARDED_WRITER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace pcap {
+
+// What decoded messages are sharded by
+enum class ShardKey
+{
+    SecurityId, // security_id, or its hash bucket when shardCount is set
+    Template,   // SBE template id (message type)
+    Group,      // Multicast group and port the packet was sent to
+};
+
+// Sharded output settings
+struct ShardOptions
+{
+    ShardKey key = ShardKey::SecurityId;
+    std::string directory;         // Output directory, must exist
+    unsigned shardCount = 0;       // Security hash buckets, 0 for one each
+    size_t maxOpenFiles = 64;      // Open descriptors kept in the LRU
+    size_t bufferSize = 64 * 1024; // Bytes buffered per shard before flush
+    unsigned flushThreads = 2;     // Writer threads, at most maxOpenFiles
+
+    // Bytes buffered across all shards before the least recently appended
+    // buffer is queued early
+    size_t maxBufferedBytes = 32 * 1024 * 1024;
+};
+
+// Routes output lines to many files. Each shard buffers in memory and full
+// buffers are written by a background thread pool, in order per shard. The
+// buffered memory is bounded by queueing the least recently appended buffer
+// early, and the number of open file descriptors by closing the least
+// recently used ones.
+class ShardedWriter
+{
+public:
+    explicit ShardedWriter(const ShardOptions& options);
+    ~ShardedWriter();
+
+    ShardedWriter(const ShardedWriter&) = delete;
+    ShardedWriter& operator=(const ShardedWriter&) = delete;
+
+    // Shard key of a message for the configured ShardKey
+    uint64_t securityKey(int32_t securityId) const noexcept;
+    static uint64_t groupKey(uint32_t address, uint16_t port) noexcept
+    {
+        return (static_cast<uint64_t>(address) << 16) | port;
+    }
+
+    // Append data to the shard identified by key
+    void append(uint64_t key, const std::string& data);
+
+    // Write all buffered data, stop the threads and close the files. Throws
+    // if any write failed.
+    void finish();
+
+    size_t shardCount() const noexcept { return shards.size(); }
+
+private:
+    struct Shard
+    {
+        std::string path;
+        std::string buffer;              // Producer side, not yet queued
+        std::deque<std::string> chunks;  // Queued for the flush threads
+        bool scheduled = false;          // Shard is in the work queue
+        bool created = false;            // File was truncated already
+        bool writing = false;            // A flush thread owns the fd
+        int fd = -1;
+        std::list<Shard*>::iterator lru; // Position among the open files
+
+        // Position among the buffered shards while the buffer is not empty
+        std::list<Shard*>::iterator appended;
+    };
+
+    ShardOptions options;
+    std::unordered_map<uint64_t, std::unique_ptr<Shard>> shards;
+
+    // Producer side: shards with a non-empty buffer, most recently appended
+    // first, and the bytes held by those buffers
+    std::list<Shard*> buffered;
+    size_t bufferedBytes = 0;
+
+    std::mutex mutex;
+    std::condition_variable workReady;
+    std::condition_variable spaceReady;
+    std::deque<Shard*> work;
+    std::list<Shard*> openFiles; // Most recently used first
+    size_t openingFiles = 0;     // Descriptors being opened by flush threads
+    size_t queuedBytes = 0;
+    bool stopping = false;
+    bool finished = false;
+    std::string error;
+    std::vector<std::thread> threads;
+
+    std::string fileName(uint64_t key) const;
+    void enqueue(Shard& shard);
+    void run();
+    void writeChunks(Shard& shard, std::deque<std::string>& chunks);
+    void openFile(Shard& shard, std::unique_lock<std::mutex>& lock);
+};
+
+} // namespace pcap
+
+#endif // SHARDED_WRITER_HPP
@@ -0,0 +1,164 @@
+#ifndef SIMBA_C_H
+#define SIMBA_C_H
+
+/*
+ * Stable C interface of the simba library, usable from C and from other
+ * languages through their FFI (e.g. Python ctypes).
+ *
+ * Typical use: open a capture, read packets in batches and decode each
+ * batch into caller-provided record arrays.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Incremented whenever a struct layout or function signature changes */
+#define SIMBA_ABI_VERSION 2
+
+/* Opaque pcap reader */
+typedef struct simba_pcap simba_pcap;
+
+/* A UDP payload (SIMBA packet) read from a capture */
+typedef struct simba_packet
+{
+    const uint8_t* data;
+    size_t size;
+    uint64_t timestamp_ns;        /* Capture time */
+    uint32_t destination_address; /* Network byte order */
+    uint16_t destination_port;    /* Network byte order */
+} simba_packet;
+
+/* Decoded OrderUpdate, prices are Decimal5 mantissas (value * 1e5) */
+typedef struct simba_order_update_record
+{
+    uint32_t packet_index; /* Index of the packet in the decoded batch */
+    uint32_t msg_seq_num;
+    uint64_t transact_time;
+    int64_t md_entry_id;
+    int64_t md_entry_px;
+    int64_t md_entry_size;
+    uint64_t md_flags;
+    uint64_t md_flags2;
+    int32_t security_id;
+    uint32_t rpt_seq;
+    uint8_t md_update_action;
+    char md_entry_type;
+} simba_order_update_record;
+
+/* Decoded OrderExecution */
+typedef struct simba_order_execution_record
+{
+    uint32_t packet_index;
+    uint32_t msg_seq_num;
+    uint64_t transact_time;
+    int64_t md_entry_id;
+    int64_t md_entry_px; /* INT64_MAX when null */
+    int64_t md_entry_size;
+    int64_t last_px;
+    int64_t last_qty;
+    int64_t trade_id;
+    uint64_t md_flags;
+    uint64_t md_flags2;
+    int32_t security_id;
+    uint32_t rpt_seq;
+    uint8_t md_update_action;
+    char md_entry_type;
+} simba_order_execution_record;
+
+/* One OrderBookSnapshot entry together with its snapshot fields */
+typedef struct simba_snapshot_entry_record
+{
+    uint32_t packet_index;
+    uint32_t msg_seq_num;
+    int32_t security_id;
+    uint32_t last_msg_seq_num_processed;
+    uint32_t rpt_seq;
+    uint32_t exchange_trading_session_id;
+    int64_t md_entry_id;
+    uint64_t transact_time;
+    int64_t md_entry_px; /* INT64_MAX when null */
+    int64_t md_entry_size;
+    int64_t trade_id;
+    uint64_t md_flags;
+    uint64_t md_flags2;
+    char md_entry_type;
+} simba_snapshot_entry_record;
+
+/* What the validating decoder accepted and skipped */
+typedef struct simba_decode_stats
+{
+    uint64_t packets;
+    uint64_t messages;
+    uint64_t truncated_packets;  /* Shorter than their headers or msg_size */
+    uint64_t truncated_messages; /* Running past msg_size, rest skipped */
+    uint64_t bad_block_lengths;  /* Block shorter than the fixed fields */
+    uint64_t unknown_templates;  /* Skipped by block_length */
+} simba_decode_stats;
+
+/*
+ * Caller-provided output arrays. The counts are set by simba_decode_batch,
+ * the stats are accumulated across calls and should be zeroed initially.
+ * An array that is NULL or has no capacity skips its message type.
+ */
+typedef struct simba_batch
+{
+    simba_order_update_record* order_updates;
+    size_t order_updates_capacity;
+    size_t order_updates_count;
+
+    simba_order_execution_record* order_executions;
+    size_t order_executions_capacity;
+    size_t order_executions_count;
+
+    simba_snapshot_entry_record* snapshot_entries;
+    size_t snapshot_entries_capacity;
+    size_t snapshot_entries_count;
+
+    simba_decode_stats stats;
+} simba_batch;
+
+/* Returns SIMBA_ABI_VERSION of the library that is loaded */
+int simba_abi_version(void);
+
+/*
+ * Message describing the failure of the last call on the calling thread,
+ * empty if it succeeded
+ */
+const char* simba_last_error(void);
+
+/* Open a capture, returns NULL on failure */
+simba_pcap* simba_pcap_open(const char* path);
+
+/*
+ * Read up to capacity packets. Returns the number read, fewer than capacity
+ * at the end of the capture or on failure, which simba_last_error tells
+ * apart. The packets read before a failure are valid. The packet data stays
+ * valid until the next call on the same reader.
+ */
+size_t simba_pcap_next_batch(simba_pcap* pcap,
+                             simba_packet* packets,
+                             size_t capacity);
+
+void simba_pcap_close(simba_pcap* pcap);
+
+/*
+ * Decode packets into the batch arrays. Returns the number of packets
+ * decoded; it stops before the first packet whose messages do not fit, so
+ * call again with the remaining packets after consuming the records. If
+ * the first packet does not fit even in empty arrays, returns 0 and sets
+ * simba_last_error; enlarge the array it names or skip the packet.
+ * Malformed packets and messages are skipped and counted in batch->stats.
+ */
+size_t simba_decode_batch(const simba_packet* packets,
+                          size_t count,
+                          simba_batch* batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIMBA_C_H */
@@ -4,25 +4,214 @@
 #include "simba_messages.hpp"
 #include <vector>
 #include <cstdint>
+#include <ostream>
 #include <string>
 
 namespace simba {
 
+// A packet payload handed to the batch decoder. The layout matches
+// simba_packet in simba_c.h.
+struct PacketView
+{
+    const uint8_t* data;
+    size_t size;
+    uint64_t timestamp_ns;        // Capture time
+    uint32_t destination_address; // Network byte order
+    uint16_t destination_port;    // Network byte order
+};
+
+// Flat, naturally aligned records filled by the batch decoder. Each carries
+// the index of its packet in the batch and the packet level fields. The
+// layouts match the simba_*_record structs in simba_c.h.
+struct OrderUpdateRecord
+{
+    uint32_t packet_index;
+    uint32_t msg_seq_num;
+    uint64_t transact_time;
+    int64_t md_entry_id;
+    int64_t md_entry_px; // Decimal5 mantissa
+    int64_t md_entry_size;
+    uint64_t md_flags;
+    uint64_t md_flags2;
+    int32_t security_id;
+    uint32_t rpt_seq;
+    uint8_t md_update_action;
+    char md_entry_type;
+};
+
+struct OrderExecutionRecord
+{
+    uint32_t packet_index;
+    uint32_t msg_seq_num;
+    uint64_t transact_time;
+    int64_t md_entry_id;
+    int64_t md_entry_px; // Decimal5NULL mantissa
+    int64_t md_entry_size;
+    int64_t last_px; // Decimal5 mantissa
+    int64_t last_qty;
+    int64_t trade_id;
+    uint64_t md_flags;
+    uint64_t md_flags2;
+    int32_t security_id;
+    uint32_t rpt_seq;
+    uint8_t md_update_action;
+    char md_entry_type;
+};
+
+// One record per OrderBookSnapshot entry, repeating the snapshot fields
+struct SnapshotEntryRecord
+{
+    uint32_t packet_index;
+    uint32_t msg_seq_num;
+    int32_t security_id;
+    uint32_t last_msg_seq_num_processed;
+    uint32_t rpt_seq;
+    uint32_t exchange_trading_session_id;
+    int64_t md_entry_id;
+    uint64_t transact_time;
+    int64_t md_entry_px; // Decimal5NULL mantissa
+    int64_t md_entry_size;
+    int64_t trade_id;
+    uint64_t md_flags;
+    uint64_t md_flags2;
+    char md_entry_type;
+};
+
+// Counters of what the validating decoder accepted and skipped. The layout
+// matches simba_decode_stats in simba_c.h.
+struct DecodeStats
+{
+    uint64_t packets = 0;           // Packets decoded
+    uint64_t messages = 0;          // Messages decoded
+    uint64_t truncatedPackets = 0;  // Shorter than their headers or msg_size
+    uint64_t truncatedMessages = 0; // Running past msg_size, rest skipped
+    uint64_t badBlockLengths = 0;   // Block shorter than the fixed fields
+    uint64_t unknownTemplates = 0;  // Skipped by block_length
+
+    DecodeStats& operator+=(const DecodeStats& other) noexcept
+    {
+        packets += other.packets;
+        messages += other.messages;
+        truncatedPackets += other.truncatedPackets;
+        truncatedMessages += other.truncatedMessages;
+        badBlockLengths += other.badBlockLengths;
+        unknownTemplates += other.unknownTemplates;
+        return *this;
+    }
+
+    // Packets and messages dropped because they were malformed
+    uint64_t rejected() const noexcept
+    {
+        return truncatedPackets + truncatedMessages + badBlockLengths;
+    }
+};
+
+// Caller-provided output buffers of the batch decoder. The counts are set
+// by decodeBatch() and the stats are accumulated across calls. The layout
+// matches simba_batch in simba_c.h.
+struct DecodeBuffers
+{
+    OrderUpdateRecord* orderUpdates;
+    size_t orderUpdatesCapacity;
+    size_t orderUpdatesCount;
+
+    OrderExecutionRecord* orderExecutions;
+    size_t orderExecutionsCapacity;
+    size_t orderExecutionsCount;
+
+    SnapshotEntryRecord* snapshotEntries;
+    size_t snapshotEntriesCapacity;
+    size_t snapshotEntriesCount;
+
+    DecodeStats stats;
+};
+
+// Receives the messages of a packet one at a time, in wire order
+class MessageHandler
+{
+public:
+    virtual ~MessageHandler() = default;
+
+    virtual void onOrderUpdate(const OrderUpdate& update) = 0;
+    virtual void onOrderExecution(const OrderExecution& execution) = 0;
+    virtual void onOrderBookSnapshot(const OrderBookSnapshot& snapshot) = 0;
+};
+
 class SimbaDecoder
 {
 public:
     // Constructor: Initialize decoder with packet data
     explicit SimbaDecoder(const std::vector<uint8_t>& packetData);
+    explicit SimbaDecoder(const uint8_t* data, size_t size);
+
+    // Decode a batch of packets into the caller's buffers. Returns the
+    // number of packets decoded, stopping before the first packet whose
+    // messages do not fit in the remaining capacity. Message types whose
+    // array is null or has no capacity are skipped. Throws
+    // std::length_error if the first packet does not fit in empty buffers.
+    static size_t decodeBatch(const PacketView* packets,
+                              size_t count,
+                              DecodeBuffers& buffers);
 
-    // Main method to decode the packet data into structured messages
+    // Main method to decode the packet data into structured messages.
+    // Every length is validated; malformed messages are skipped and counted
+    // in getStats().
     void decode();
 
+    // Decode the packet handing each message to the handler in wire order
+    // instead of storing it. Validation and stats are as for decode().
+    void decode(MessageHandler& handler);
+
     // Convert the decoded messages to a JSON string
     std::string toJSON() const;
 
+    // Serialize a single message as a JSON object
+    static void writeJSON(std::ostream& json, const OrderUpdate& update);
+    static void writeJSON(std::ostream& json, const OrderExecution& execution);
+    static void writeJSON(std::ostream& json,
+                          const OrderBookSnapshot& snapshot);
+
+    // Accessors for the decoded headers and messages
+    const MarketDataPacketHeader& getPacketHeader() const noexcept
+    {
+        return marketDataPacketHeader;
+    }
+    // Transact time of an incremental packet, 0 for snapshot packets
+    uint64_t getTransactTime() const noexcept
+    {
+        return incrementalPacketHeader.transact_time;
+    }
+    const std::vector<OrderUpdate>& getOrderUpdates() const noexcept
+    {
+        return orderUpdates;
+    }
+    const std::vector<OrderExecution>& getOrderExecutions() const noexcept
+    {
+        return orderExecutions;
+    }
+    const std::vector<OrderBookSnapshot>& getOrderBookSnapshots()
+      const noexcept
+    {
+        return orderBookSnapshots;
+    }
+    const DecodeStats& getStats() const noexcept { return stats; }
+
 private:
-    // Reference to the packet data to decode
-    const std::vector<uint8_t>& packetData;
+    // Packet data to decode
+    const uint8_t* packetData;
+    size_t packetSize;
+
+    // Append the packet's messages to the batch buffers, returns false,
+    // names the full array and leaves the counts untouched if they do not
+    // fit
+    bool decodeInto(DecodeBuffers& buffers,
+                    uint32_t packetIndex,
+                    const char*& full);
+
+    // Validate the packet and hand each well-formed message to the sink,
+    // returns false if the sink stopped the walk
+    template<typename Sink>
+    bool walk(Sink& sink);
 
     // Parse headers
     MarketDataPacketHeader parseMarketDataPacketHeader(
@@ -31,10 +220,18 @@ private:
       size_t& offset) const noexcept;
     SBEHeader parseSBEHeader(size_t& offset) const noexcept;
 
-    // Decoders for each message type
+    // Decoders for each message type, the lengths are checked by walk()
     OrderUpdate decodeOrderUpdate(size_t& offset) const noexcept;
     OrderExecution decodeOrderExecution(size_t& offset) const noexcept;
-    OrderBookSnapshot decodeOrderBookSnapshot(size_t& offset) const;
+    OrderBookSnapshot decodeOrderBookSnapshot(
+      size_t& offset,
+      uint16_t blockLength) const noexcept;
+
+    // Decoded packet headers
+    MarketDataPacketHeader marketDataPacketHeader;
+    IncrementalPacketHeader incrementalPacketHeader;
+
+    DecodeStats stats;
 
     // Storage for decoded messages
     std::vector<OrderUpdate> orderUpdates;
@@ -27,6 +27,9 @@ struct Decimal5NULL
     static constexpr double exponent = 1e-5;
 };
 
+// Exact accumulator for sums of Decimal5 price * quantity products
+__extension__ typedef __int128 Notional;
+
 // Market Data Packet Header structure
 struct MarketDataPacketHeader
 {
@@ -203,6 +206,9 @@ struct OrderBookSnapshot
     static constexpr size_t SIZE =
       sizeof(security_id) + sizeof(last_msg_seq_num_processed) +
       sizeof(rpt_seq) + sizeof(exchange_trading_session_id) + GroupSize::SIZE;
+
+    // Root block, i.e. the fields before the NoMDEntries group header
+    static constexpr size_t BLOCK_LENGTH = SIZE - GroupSize::SIZE;
 };
 static_assert(OrderBookSnapshot::SIZE == 19,
               "OrderBookSnapshot size is incorrect");
@@ -0,0 +1,269 @@
+#ifndef TIME_SERIES_STORE_HPP
+#define TIME_SERIES_STORE_HPP
+
+#include "simba_decoder.hpp"
+#include "simba_messages.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#pragma pack(push, 1) // On-disk layout, no padding
+
+namespace simba {
+
+// Decoded OrderUpdate or OrderExecution as stored on disk
+struct StoredMessage
+{
+    uint64_t time; // Transact time, nanoseconds since the epoch
+    int32_t security_id;
+    uint16_t template_id; // OrderUpdate::TEMPLATE_ID or OrderExecution's
+    uint8_t md_update_action;
+    char md_entry_type;
+    int64_t md_entry_id;
+    int64_t price;    // md_entry_px or last_px, Decimal5 mantissa
+    int64_t quantity; // md_entry_size or last_qty
+    int64_t trade_id; // 0 for updates
+    uint64_t md_flags;
+    uint32_t msg_seq_num;
+    uint32_t rpt_seq;
+
+    static constexpr size_t SIZE =
+      sizeof(time) + sizeof(security_id) + sizeof(template_id) +
+      sizeof(md_update_action) + sizeof(md_entry_type) + sizeof(md_entry_id) +
+      sizeof(price) + sizeof(quantity) + sizeof(trade_id) + sizeof(md_flags) +
+      sizeof(msg_seq_num) + sizeof(rpt_seq);
+};
+static_assert(StoredMessage::SIZE == 64, "StoredMessage size is incorrect");
+
+// Rows of one security inside a partition, sorted by time
+struct SecurityRange
+{
+    int32_t security_id;
+    uint64_t first_row;
+    uint64_t row_count;
+
+    static constexpr size_t SIZE =
+      sizeof(security_id) + sizeof(first_row) + sizeof(row_count);
+};
+static_assert(SecurityRange::SIZE == 20, "SecurityRange size is incorrect");
+
+// Zone map of a partition, used to skip partitions a query cannot match
+struct ZoneMap
+{
+    uint64_t start_time; // Partition start, nanoseconds since the epoch
+    uint64_t row_count;
+    uint64_t execution_count;
+    uint32_t security_count;
+    int32_t min_security_id;
+    int32_t max_security_id;
+    uint64_t min_time;
+    uint64_t max_time;
+    int64_t min_price;
+    int64_t max_price;
+
+    static constexpr size_t SIZE =
+      sizeof(start_time) + sizeof(row_count) + sizeof(execution_count) +
+      sizeof(security_count) + sizeof(min_security_id) +
+      sizeof(max_security_id) + sizeof(min_time) + sizeof(max_time) +
+      sizeof(min_price) + sizeof(max_price);
+};
+static_assert(ZoneMap::SIZE == 68, "ZoneMap size is incorrect");
+
+// Capture merged into a store, so that it is not merged twice
+struct IngestedCapture
+{
+    uint64_t size; // File size in bytes
+    uint64_t hash; // FNV-1a of the global header, packet headers and payloads
+
+    static constexpr size_t SIZE = sizeof(size) + sizeof(hash);
+
+    // Fold bytes into the hash
+    void add(const void* data, size_t length) noexcept;
+
+    bool operator==(const IngestedCapture& other) const noexcept
+    {
+        return size == other.size && hash == other.hash;
+    }
+};
+static_assert(IngestedCapture::SIZE == 16, "IngestedCapture size is incorrect");
+
+// Header of the manifest and of every partition file. The manifest's zone
+// maps are followed by a uint64_t count of IngestedCapture records.
+struct StoreFileHeader
+{
+    static constexpr uint64_t MANIFEST_MAGIC = 0x334E414D41424D53; // SMBAMAN3
+    static constexpr uint64_t PARTITION_MAGIC = 0x3154525041424D53; // SMBAPRT1
+
+    uint64_t magic;
+    uint64_t partition_ns; // Partition length
+    uint64_t count;        // Zone maps that follow (1 in a partition file)
+
+    static constexpr size_t SIZE =
+      sizeof(magic) + sizeof(partition_ns) + sizeof(count);
+};
+static_assert(StoreFileHeader::SIZE == 24,
+              "StoreFileHeader size is incorrect");
+
+#pragma pack(pop)
+
+// Inclusive range filter on one field
+struct FieldRange
+{
+    int64_t low = INT64_MIN;
+    int64_t high = INT64_MAX;
+
+    bool contains(int64_t value) const noexcept
+    {
+        return value >= low && value <= high;
+    }
+    bool overlaps(int64_t min, int64_t max) const noexcept
+    {
+        return min <= high && max >= low;
+    }
+};
+
+// Aggregates a query can compute
+enum class Aggregation
+{
+    Count,
+    SumQty,
+    MinPrice,
+    MaxPrice,
+    FirstPrice,
+    LastPrice,
+    Vwap,
+    MinTime,
+    MaxTime,
+};
+
+// A parsed query:
+//   executions|updates|messages
+//     [where <cond> [and <cond>]...]
+//     [select <aggregate>[, <aggregate>]...] [by security_id] [limit <n>]
+// where <cond> is "<field> <op> <value>" or "<field> between <a> and <b>",
+// <field> one of security_id, time, price, qty, trade_id or side, <op> one of
+// = < <= > >=, and <aggregate> one of count, vwap, sum(qty), min(price),
+// max(price), first(price), last(price), min(time), max(time). Times are
+// nanoseconds or UTC "YYYY-MM-DDTHH:MM:SS[.fraction]", prices are decimals.
+struct Query
+{
+    uint16_t templateId = 0; // 0 matches updates and executions
+    FieldRange securityId;
+    FieldRange time;
+    FieldRange price;
+    FieldRange quantity;
+    FieldRange tradeId;
+    char side = 0; // MDEntryType, 0 matches both sides
+
+    std::vector<Aggregation> aggregations;
+    bool bySecurity = false;
+    uint64_t limit = UINT64_MAX;
+
+    // Parse the query grammar above, throws on syntax errors
+    static Query parse(const std::string& text);
+
+    bool matches(const StoredMessage& row) const noexcept;
+};
+
+// Running aggregate of matching rows. The scan passes only the first
+// execution of each trade_id, so executions are counted per trade.
+struct QueryAggregate
+{
+    uint64_t count = 0;
+    int64_t sumQty = 0;
+    Notional notional = 0;
+    int64_t minPrice = INT64_MAX;
+    int64_t maxPrice = INT64_MIN;
+    uint64_t firstTime = UINT64_MAX;
+    int64_t firstPrice = 0;
+    uint64_t lastTime = 0;
+    int64_t lastPrice = 0;
+
+    void add(const StoredMessage& row) noexcept;
+    void merge(const QueryAggregate& other) noexcept;
+};
+
+// Output of a query
+struct QueryResult
+{
+    std::vector<StoredMessage> rows;              // Without aggregations
+    std::map<int32_t, QueryAggregate> bySecurity; // Key 0 when not grouped
+    size_t partitionsScanned = 0;
+    size_t partitionsTotal = 0;
+
+    void write(std::ostream& out, const Query& query) const;
+};
+
+// Builds a store from pcap captures. Messages are bucketed into
+// time partitions, and each partition file is sorted by security_id and
+// time. Adding captures to an existing store merges into its partitions;
+// the manifest records the captures merged so far.
+class StoreBuilder
+{
+public:
+    explicit StoreBuilder(const std::string& directory,
+                          uint64_t partitionNs = 3600000000000ULL);
+
+    // Decode the executions and order updates of a capture, hashing it in
+    // the same pass. Returns false without decoding it if the store already
+    // holds the same capture.
+    bool addCapture(const std::string& pcapFile);
+
+    // Write pending partitions and the manifest
+    void finish();
+
+    const DecodeStats& getDecodeStats() const noexcept { return stats; }
+
+private:
+    std::string directory;
+    uint64_t partitionNs;
+    std::map<uint64_t, std::vector<StoredMessage>> pending;
+    size_t pendingRows;
+    std::map<uint64_t, ZoneMap> partitions;
+    std::vector<IngestedCapture> captures;
+    DecodeStats stats;
+
+    void flush();
+    void writePartition(uint64_t start, std::vector<StoredMessage>& rows);
+};
+
+// Read-only view of a store. Partition files are memory-mapped once and
+// reused by every query.
+class TimeSeriesStore
+{
+public:
+    explicit TimeSeriesStore(const std::string& directory);
+    ~TimeSeriesStore();
+
+    TimeSeriesStore(const TimeSeriesStore&) = delete;
+    TimeSeriesStore& operator=(const TimeSeriesStore&) = delete;
+
+    // Run a query over the partitions its zone maps allow, in parallel. A
+    // thread count of 0 picks one per hardware thread.
+    QueryResult run(const Query& query, unsigned threads = 0);
+
+private:
+    struct Partition
+    {
+        ZoneMap zone;
+        std::string path;
+        const uint8_t* mapping = nullptr;
+        size_t mappingSize = 0;
+        const SecurityRange* ranges = nullptr;
+        const StoredMessage* rows = nullptr;
+    };
+
+    std::vector<Partition> partitions;
+
+    void map(Partition& partition);
+    void scan(const Partition& partition,
+              const Query& query,
+              QueryResult& result) const;
+};
+
+} // namespace simba
+
+#endif // TIME_SERIES_STORE_HPP
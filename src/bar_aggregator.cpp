@@ -0,0 +1,449 @@
+#include "../include/bar_aggregator.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace simba {
+
+namespace {
+
+// Executions handed to a worker at a time
+constexpr size_t BATCH_SIZE = 4096;
+
+// Batches a worker may have queued before the producer waits
+constexpr size_t MAX_QUEUED_BATCHES = 64;
+
+// Largest and smallest Notional values
+const Notional NOTIONAL_MAX =
+  (static_cast<Notional>(INT64_MAX) << 64) | static_cast<Notional>(UINT64_MAX);
+const Notional NOTIONAL_MIN = -NOTIONAL_MAX - 1;
+
+// Append a trivially copyable value to a state buffer
+template<typename T>
+void append(std::vector<uint8_t>& state, const T& value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    state.insert(state.end(), bytes, bytes + sizeof(T));
+}
+
+// Read a trivially copyable value from a state buffer
+template<typename T>
+T extract(const std::vector<uint8_t>& state, size_t& offset)
+{
+    if (state.size() - offset < sizeof(T)) {
+        throw std::runtime_error("Error: Truncated aggregator state.");
+    }
+    T value;
+    std::memcpy(&value, &state[offset], sizeof(T));
+    offset += sizeof(T);
+    return value;
+}
+
+// Append the fields of a bar, without the padding of the struct
+void appendBar(std::vector<uint8_t>& state, const Bar& bar)
+{
+    append(state, bar.security_id);
+    append(state, bar.start_time);
+    append(state, bar.open);
+    append(state, bar.high);
+    append(state, bar.low);
+    append(state, bar.close);
+    append(state, bar.volume);
+    append(state, bar.notional);
+    append(state, bar.trades);
+    append(state, bar.first_trade_id);
+    append(state, bar.last_trade_id);
+}
+
+Bar extractBar(const std::vector<uint8_t>& state, size_t& offset)
+{
+    Bar bar{};
+    bar.security_id = extract<int32_t>(state, offset);
+    bar.start_time = extract<uint64_t>(state, offset);
+    bar.open = extract<int64_t>(state, offset);
+    bar.high = extract<int64_t>(state, offset);
+    bar.low = extract<int64_t>(state, offset);
+    bar.close = extract<int64_t>(state, offset);
+    bar.volume = extract<int64_t>(state, offset);
+    bar.notional = extract<Notional>(state, offset);
+    bar.trades = extract<uint32_t>(state, offset);
+    bar.first_trade_id = extract<int64_t>(state, offset);
+    bar.last_trade_id = extract<int64_t>(state, offset);
+    return bar;
+}
+
+// Order bars by security_id and start time
+bool barBefore(const Bar& a, const Bar& b)
+{
+    return a.security_id != b.security_id ? a.security_id < b.security_id
+                                          : a.start_time < b.start_time;
+}
+
+// Write one CSV line with exact decimal prices
+void writeBar(std::ostream& out, const Bar& bar)
+{
+    out << bar.security_id << ',' << bar.start_time << ','
+        << formatDecimal5(bar.open) << ',' << formatDecimal5(bar.high) << ','
+        << formatDecimal5(bar.low) << ',' << formatDecimal5(bar.close) << ','
+        << bar.volume << ',' << formatDecimal5(bar.vwap()) << ','
+        << bar.trades << ',' << bar.first_trade_id << ','
+        << bar.last_trade_id << '\n';
+}
+
+} // namespace
+
+int64_t Bar::vwap() const noexcept
+{
+    return simba::vwap(notional, volume);
+}
+
+// Compute the VWAP from the exact notional
+int64_t saturatingAdd(int64_t a, int64_t b) noexcept
+{
+    int64_t sum;
+    if (__builtin_add_overflow(a, b, &sum)) {
+        return b < 0 ? INT64_MIN : INT64_MAX;
+    }
+    return sum;
+}
+
+Notional saturatingAdd(Notional a, Notional b) noexcept
+{
+    Notional sum;
+    if (__builtin_add_overflow(a, b, &sum)) {
+        return b < 0 ? NOTIONAL_MIN : NOTIONAL_MAX;
+    }
+    return sum;
+}
+
+int64_t vwap(Notional notional, int64_t volume) noexcept
+{
+    if (volume <= 0) {
+        return 0;
+    }
+    // Round half away from zero on the remainder, which cannot overflow
+    // even for a saturated notional
+    Notional quotient = notional / volume;
+    const Notional remainder = notional % volume;
+    const Notional magnitude = remainder < 0 ? -remainder : remainder;
+    if (magnitude * 2 >= volume) {
+        quotient += remainder < 0 ? -1 : 1;
+    }
+    return static_cast<int64_t>(std::min<Notional>(
+      std::max<Notional>(quotient, INT64_MIN), INT64_MAX));
+}
+
+// Format a Decimal5 mantissa with exactly five fractional digits
+std::string formatDecimal5(int64_t mantissa)
+{
+    const bool negative = mantissa < 0;
+    const uint64_t magnitude =
+      negative ? 0 - static_cast<uint64_t>(mantissa) : mantissa;
+
+    std::string fraction = std::to_string(magnitude % 100000);
+    fraction.insert(0, 5 - fraction.size(), '0');
+    return (negative ? "-" : "") + std::to_string(magnitude / 100000) + "." +
+           fraction;
+}
+
+// Constructor starts one worker thread per shard
+BarAggregator::BarAggregator(uint64_t intervalNs, unsigned workers)
+  : intervalNs(intervalNs)
+  , finished(false)
+{
+    if (intervalNs == 0) {
+        throw std::runtime_error("Error: Bar interval must be positive.");
+    }
+    if (workers == 0) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned i = 0; i < workers; ++i) {
+        shards.emplace_back(new Shard);
+        shards.back()->pending.reserve(BATCH_SIZE);
+    }
+    for (auto& shard : shards) {
+        Shard& owned = *shard;
+        owned.thread = std::thread([this, &owned]() { run(owned); });
+    }
+}
+
+// Destructor makes sure the workers are joined
+BarAggregator::~BarAggregator()
+{
+    if (!finished) {
+        finish();
+    }
+}
+
+// Route the execution to the shard owning its instrument
+void BarAggregator::add(const OrderExecution& execution, uint64_t timeNs)
+{
+    const uint32_t key = static_cast<uint32_t>(execution.security_id);
+    Shard& shard = *shards[key % shards.size()];
+
+    Trade trade;
+    trade.security_id = execution.security_id;
+    trade.price = execution.last_px.mantissa;
+    trade.quantity = execution.last_qty;
+    trade.trade_id = execution.trade_id;
+    trade.time = timeNs;
+    shard.pending.push_back(trade);
+
+    if (shard.pending.size() >= BATCH_SIZE) {
+        publish(shard);
+    }
+}
+
+// Hand the producer side batch to the worker, waiting if it is behind
+void BarAggregator::publish(Shard& shard)
+{
+    std::vector<Trade> batch;
+    batch.reserve(BATCH_SIZE);
+    batch.swap(shard.pending);
+
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    shard.drained.wait(
+      lock, [&shard]() { return shard.queue.size() < MAX_QUEUED_BATCHES; });
+    shard.queue.push_back(std::move(batch));
+    lock.unlock();
+    shard.ready.notify_one();
+}
+
+// Flush the remaining batches and join the workers
+void BarAggregator::finish()
+{
+    for (auto& shard : shards) {
+        if (!shard->pending.empty()) {
+            publish(*shard);
+        }
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->stopping = true;
+        shard->ready.notify_one();
+    }
+    for (auto& shard : shards) {
+        shard->thread.join();
+    }
+    finished = true;
+
+    for (auto& shard : shards) {
+        for (auto& entry : shard->instruments) {
+            Instrument& instrument = entry.second;
+            if (instrument.hasBar) {
+                instrument.completed.push_back(instrument.current);
+                instrument.hasBar = false;
+            }
+        }
+    }
+}
+
+// Publish the producer side batches and wait for the workers to go idle
+void BarAggregator::drain()
+{
+    for (auto& shard : shards) {
+        if (!shard->pending.empty()) {
+            publish(*shard);
+        }
+    }
+    for (auto& shard : shards) {
+        Shard& owned = *shard;
+        std::unique_lock<std::mutex> lock(owned.mutex);
+        owned.drained.wait(
+          lock, [&owned]() { return owned.queue.empty() && !owned.busy; });
+    }
+}
+
+// Write and release the completed bars of every shard
+void BarAggregator::writeCompleted(std::ostream& out)
+{
+    drain();
+
+    std::vector<Bar> completed;
+    for (auto& shard : shards) {
+        for (auto& entry : shard->instruments) {
+            std::vector<Bar>& bars = entry.second.completed;
+            completed.insert(completed.end(), bars.begin(), bars.end());
+            std::vector<Bar>().swap(bars);
+        }
+    }
+
+    std::sort(completed.begin(), completed.end(), barBefore);
+    for (const Bar& bar : completed) {
+        writeBar(out, bar);
+    }
+}
+
+// Serialize every instrument: security_id, last trade id, current bar and
+// the completed bars not written yet
+void BarAggregator::saveState(std::vector<uint8_t>& state)
+{
+    drain();
+
+    state.clear();
+    append(state, intervalNs);
+
+    uint64_t count = 0;
+    for (const auto& shard : shards) {
+        count += shard->instruments.size();
+    }
+    append(state, count);
+
+    for (const auto& shard : shards) {
+        for (const auto& entry : shard->instruments) {
+            const Instrument& instrument = entry.second;
+            append(state, entry.first);
+            append(state, instrument.lastTradeId);
+            append(state, static_cast<uint8_t>(instrument.hasBar));
+            appendBar(state, instrument.current);
+            append(state, static_cast<uint64_t>(instrument.completed.size()));
+            for (const Bar& bar : instrument.completed) {
+                appendBar(state, bar);
+            }
+        }
+    }
+}
+
+// Rebuild the instruments, resharding them for the current worker count
+void BarAggregator::restoreState(const std::vector<uint8_t>& state)
+{
+    size_t offset = 0;
+    if (extract<uint64_t>(state, offset) != intervalNs) {
+        throw std::runtime_error(
+          "Error: Checkpoint was taken with a different bar interval.");
+    }
+
+    const uint64_t count = extract<uint64_t>(state, offset);
+    for (uint64_t i = 0; i < count; ++i) {
+        const int32_t securityId = extract<int32_t>(state, offset);
+        const uint32_t key = static_cast<uint32_t>(securityId);
+        Shard& shard = *shards[key % shards.size()];
+        Instrument& instrument = shard.instruments[securityId];
+
+        instrument.lastTradeId = extract<int64_t>(state, offset);
+        instrument.hasBar = extract<uint8_t>(state, offset) != 0;
+        instrument.current = extractBar(state, offset);
+
+        // Each bar takes at least one byte, which bounds the count
+        const uint64_t completed = extract<uint64_t>(state, offset);
+        if (completed > state.size() - offset) {
+            throw std::runtime_error("Error: Truncated aggregator state.");
+        }
+        instrument.completed.resize(completed);
+        for (Bar& bar : instrument.completed) {
+            bar = extractBar(state, offset);
+        }
+    }
+}
+
+// Worker loop: aggregate queued batches until stopped
+void BarAggregator::run(Shard& shard)
+{
+    std::vector<Trade> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            shard.ready.wait(lock, [&shard]() {
+                return shard.stopping || !shard.queue.empty();
+            });
+            if (shard.queue.empty()) {
+                return;
+            }
+            batch = std::move(shard.queue.front());
+            shard.queue.pop_front();
+            shard.busy = true;
+        }
+        shard.drained.notify_one();
+
+        for (const Trade& trade : batch) {
+            aggregate(shard, trade);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.busy = false;
+        }
+        shard.drained.notify_one();
+    }
+}
+
+// Fold one execution into the bar of its instrument
+void BarAggregator::aggregate(Shard& shard, const Trade& trade)
+{
+    auto it = shard.instruments.find(trade.security_id);
+    if (it == shard.instruments.end()) {
+        Instrument instrument{};
+        instrument.lastTradeId = INT64_MIN;
+        it = shard.instruments.emplace(trade.security_id, instrument).first;
+    }
+    Instrument& instrument = it->second;
+
+    // Both sides of a trade are reported as executions with the same
+    // trade_id, and trade ids increase monotonically, so count each once
+    if (trade.trade_id <= instrument.lastTradeId || trade.quantity <= 0) {
+        return;
+    }
+    instrument.lastTradeId = trade.trade_id;
+
+    const uint64_t start = trade.time - trade.time % intervalNs;
+    Bar& bar = instrument.current;
+
+    // Late executions for an earlier interval stay in the current bar
+    if (!instrument.hasBar || start > bar.start_time) {
+        if (instrument.hasBar) {
+            instrument.completed.push_back(bar);
+        }
+        bar = Bar{};
+        bar.security_id = trade.security_id;
+        bar.start_time = start;
+        bar.open = bar.high = bar.low = trade.price;
+        bar.first_trade_id = trade.trade_id;
+        instrument.hasBar = true;
+    }
+
+    bar.high = std::max(bar.high, trade.price);
+    bar.low = std::min(bar.low, trade.price);
+    bar.close = trade.price;
+    bar.volume = saturatingAdd(bar.volume, trade.quantity);
+    bar.notional = saturatingAdd(
+      bar.notional, static_cast<Notional>(trade.price) * trade.quantity);
+    bar.trades += 1;
+    bar.last_trade_id = trade.trade_id;
+}
+
+// Collect the bars of every shard
+std::vector<Bar> BarAggregator::bars() const
+{
+    std::vector<Bar> result;
+    for (const auto& shard : shards) {
+        for (const auto& entry : shard->instruments) {
+            const Instrument& instrument = entry.second;
+            result.insert(result.end(),
+                          instrument.completed.begin(),
+                          instrument.completed.end());
+            if (instrument.hasBar) {
+                result.push_back(instrument.current);
+            }
+        }
+    }
+
+    std::sort(result.begin(), result.end(), barBefore);
+    return result;
+}
+
+// Column names of the CSV output
+void BarAggregator::writeCSVHeader(std::ostream& out)
+{
+    out << "security_id,start_time,open,high,low,close,volume,vwap,trades,"
+           "first_trade_id,last_trade_id\n";
+}
+
+// Write one CSV line per bar with exact decimal prices
+void BarAggregator::writeCSV(std::ostream& out) const
+{
+    writeCSVHeader(out);
+    for (const Bar& bar : bars()) {
+        writeBar(out, bar);
+    }
+}
+
+} // namespace simba
@@ -0,0 +1,227 @@
+#include "../include/checkpoint.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <arpa/inet.h> // For inet_ntop and ntohs
+#include <fcntl.h>     // For open
+#include <sys/stat.h>  // For stat
+#include <unistd.h>    // For truncate and fsync
+
+namespace pcap {
+
+namespace {
+
+// Flush a file or directory to disk
+void syncPath(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Error: Could not open " + path + ".");
+    }
+    const int result = ::fsync(fd);
+    ::close(fd);
+    if (result != 0) {
+        throw std::runtime_error("Error: Could not sync " + path + ".");
+    }
+}
+
+// Directory holding path, which has to be synced for a rename to persist
+std::string parentDirectory(const std::string& path)
+{
+    const size_t slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+} // namespace
+
+// Size, modification time and global header of a capture
+CaptureIdentity CaptureIdentity::of(const std::string& path,
+                                    const PcapGlobalHeader& globalHeader)
+{
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) {
+        throw std::runtime_error("Error: Could not stat pcap file.");
+    }
+
+    CaptureIdentity identity;
+    identity.size = static_cast<uint64_t>(info.st_size);
+    identity.mtime_ns = static_cast<int64_t>(info.st_mtim.tv_sec) *
+                          1000000000 +
+                        info.st_mtim.tv_nsec;
+    identity.global_header = globalHeader;
+    return identity;
+}
+
+bool CaptureIdentity::operator==(const CaptureIdentity& other) const noexcept
+{
+    return std::memcmp(this, &other, SIZE) == 0;
+}
+
+// Track the msg_seq_num at the start of the SIMBA market data packet header
+void Checkpoint::recordPacket(const PcapPacket& packet)
+{
+    uint32_t sequence = 0;
+    if (packet.data.size() < sizeof(sequence)) {
+        return;
+    }
+    std::memcpy(&sequence, packet.data.data(), sizeof(sequence));
+
+    const uint32_t address = packet.ipHeader.destinationAddress;
+    const uint16_t port = packet.udpHeader.destinationPort;
+    for (size_t i = 0; i < feeds.size(); ++i) {
+        FeedSequence& feed = feeds[i];
+        if (feed.address != address || feed.port != port) {
+            continue;
+        }
+        if (i < unchecked.size() && unchecked[i]) {
+            unchecked[i] = false;
+            if (sequence != feed.msg_seq_num + 1) {
+                char text[INET_ADDRSTRLEN] = "";
+                inet_ntop(AF_INET, &address, text, sizeof(text));
+                std::cerr << "Warning: Feed " << text << ':' << ntohs(port)
+                          << " resumes at msg_seq_num " << sequence
+                          << ", the checkpoint expected "
+                          << feed.msg_seq_num + 1 << '.' << std::endl;
+            }
+        }
+        feed.msg_seq_num = sequence;
+        return;
+    }
+    feeds.push_back(FeedSequence{ address, port, sequence });
+}
+
+// Save to a temporary file, sync it and rename it over the previous
+// checkpoint, then sync the directory, so that neither a crash nor a power
+// loss leaves a torn checkpoint
+void Checkpoint::save(const std::string& path) const
+{
+    const std::string temporaryPath = path + ".tmp";
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Error: Could not open checkpoint file.");
+    }
+
+    CheckpointHeader header;
+    header.magic = CheckpointHeader::MAGIC;
+    header.version = CheckpointHeader::VERSION;
+    header.mode = mode;
+    header.capture = capture;
+    header.pcap_offset = pcapOffset;
+    header.output_offset = outputOffset;
+    header.packets = packets;
+    header.feed_count = static_cast<uint32_t>(feeds.size());
+    header.state_size = engineState.size();
+
+    file.write(reinterpret_cast<const char*>(&header), CheckpointHeader::SIZE);
+    file.write(reinterpret_cast<const char*>(feeds.data()),
+               feeds.size() * FeedSequence::SIZE);
+    file.write(reinterpret_cast<const char*>(engineState.data()),
+               engineState.size());
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Error writing checkpoint file.");
+    }
+
+    syncPath(temporaryPath);
+
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Error: Could not replace checkpoint file.");
+    }
+    syncPath(parentDirectory(path));
+}
+
+// Load and validate a checkpoint file
+Checkpoint Checkpoint::load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Error: Could not open checkpoint file.");
+    }
+
+    CheckpointHeader header;
+    file.read(reinterpret_cast<char*>(&header), CheckpointHeader::SIZE);
+    if (!file || header.magic != CheckpointHeader::MAGIC) {
+        throw std::runtime_error("Error: Not a checkpoint file.");
+    }
+    if (header.version != CheckpointHeader::VERSION) {
+        throw std::runtime_error("Error: Unsupported checkpoint version.");
+    }
+
+    // The feeds and the engine state must fit in the rest of the file
+    file.seekg(0, std::ios::end);
+    const uint64_t remaining =
+      static_cast<uint64_t>(file.tellg()) - CheckpointHeader::SIZE;
+    file.seekg(CheckpointHeader::SIZE);
+    if (header.feed_count > remaining / FeedSequence::SIZE ||
+        header.state_size >
+          remaining - header.feed_count * FeedSequence::SIZE) {
+        throw std::runtime_error("Error: Truncated checkpoint file.");
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.mode = header.mode;
+    checkpoint.capture = header.capture;
+    checkpoint.pcapOffset = header.pcap_offset;
+    checkpoint.outputOffset = header.output_offset;
+    checkpoint.packets = header.packets;
+
+    checkpoint.feeds.resize(header.feed_count);
+    checkpoint.unchecked.assign(header.feed_count, true);
+    file.read(reinterpret_cast<char*>(checkpoint.feeds.data()),
+              checkpoint.feeds.size() * FeedSequence::SIZE);
+    checkpoint.engineState.resize(header.state_size);
+    file.read(reinterpret_cast<char*>(checkpoint.engineState.data()),
+              checkpoint.engineState.size());
+    if (!file) {
+        throw std::runtime_error("Error reading checkpoint file.");
+    }
+    return checkpoint;
+}
+
+// Refuse to resume from a checkpoint of another run, it would corrupt the
+// output when it is truncated to outputOffset
+void Checkpoint::validate(CheckpointMode expectedMode,
+                          const CaptureIdentity& expectedCapture,
+                          const std::string& outputPath) const
+{
+    if (mode != expectedMode) {
+        throw std::runtime_error(
+          mode == CheckpointMode::Bars
+            ? "Error: Checkpoint was written by --bars, not by JSON decoding."
+            : "Error: Checkpoint was written by JSON decoding, not by --bars.");
+    }
+    if (!(capture == expectedCapture)) {
+        throw std::runtime_error(
+          "Error: Checkpoint was taken on a different or modified capture.");
+    }
+    if (pcapOffset < PcapGlobalHeader::SIZE || pcapOffset > capture.size) {
+        throw std::runtime_error("Error: Checkpoint pcap offset is invalid.");
+    }
+
+    struct stat info;
+    const uint64_t outputSize =
+      ::stat(outputPath.c_str(), &info) == 0
+        ? static_cast<uint64_t>(info.st_size)
+        : 0;
+    if (outputOffset > outputSize) {
+        throw std::runtime_error(
+          "Error: Output file is shorter than recorded in the checkpoint.");
+    }
+}
+
+// Truncate the output back to outputOffset and append from there
+void Checkpoint::reopenOutput(const std::string& outputPath,
+                              std::ofstream& out) const
+{
+    if (truncate(outputPath.c_str(), outputOffset) != 0) {
+        throw std::runtime_error("Error: Could not truncate output file.");
+    }
+    out.open(outputPath, std::ios::app);
+}
+
+} // namespace pcap
@@ -1,28 +1,530 @@
 // Author: Mert Özer
 // Email: mertt.ozer@hotmail.com
 
+#include "../include/bar_aggregator.hpp"
 #include "../include/pcap_parser.hpp"
+#include "../include/pcap_replayer.hpp"
+#include "../include/sharded_writer.hpp"
+#include "../include/simba_decoder.hpp"
+#include "../include/time_series_store.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <streambuf>
+#include <vector>
+
+namespace {
+
+// Packets between writes of the completed bars in --bars mode
+constexpr uint64_t BAR_WRITE_PACKETS = 100000;
+
+void printUsage(const char* program)
+{
+    std::cerr
+      << "Usage: " << program << " <pcap file path>"
+      << " <output file path> [checkpoint options]\n"
+      << "       " << program << " --replay <pcap file path>"
+      << " [--speed <factor>] [--max-rate] [--group <ip:port>]..."
+      << " [--interface <ip>] [--ttl <n>] [--no-loopback]"
+      << " [--batch <n>] [--loops <n>] [--sleep]\n"
+      << "       " << program << " --bars <pcap file path>"
+      << " <output file path> [--interval <seconds>] [--threads <n>]"
+      << " [--transact-time] [checkpoint options]\n"
+      << "       " << program << " --sharded <pcap file path>"
+      << " <output directory> [--by security|template|group]"
+      << " [--shards <n>] [--max-open <n>] [--flush-threads <n>]\n"
+      << "       " << program << " --build-store <store directory>"
+      << " <pcap file path>... [--partition <seconds>]\n"
+      << "       " << program << " --query <store directory> [<query>]"
+      << " [--threads <n>]\n"
+      << "Checkpoint options: [--checkpoint <file>]"
+      << " [--checkpoint-every <packets>] [--resume <file>]" << std::endl;
+}
+
+// Report data the validating decoder had to skip
+void printDecodeStats(const simba::DecodeStats& stats)
+{
+    if (stats.rejected() == 0) {
+        return;
+    }
+    std::cerr << "Warning: Skipped malformed data: " << stats.truncatedPackets
+              << " truncated packets, " << stats.truncatedMessages
+              << " truncated messages, " << stats.badBlockLengths
+              << " messages with a bad block length" << std::endl;
+}
+
+// Consume a checkpoint option at argv[i], returns false if it is not one
+bool parseCheckpointOption(const int argc,
+                           const char* argv[],
+                           int& i,
+                           pcap::CheckpointOptions& options)
+{
+    if (i + 1 >= argc) {
+        return false;
+    }
+    if (std::strcmp(argv[i], "--checkpoint") == 0) {
+        options.path = argv[++i];
+    } else if (std::strcmp(argv[i], "--checkpoint-every") == 0) {
+        options.interval = std::strtoull(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--resume") == 0) {
+        options.resumePath = argv[++i];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Aggregate executions into OHLCV/VWAP bars per instrument
+int runBars(const int argc, const char* argv[])
+{
+    if (argc < 4) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const std::string pcapFileName = argv[2];
+    const std::string outputFileName = argv[3];
+    double intervalSeconds = 60;
+    unsigned threads = 0;
+    bool transactTime = false;
+    pcap::CheckpointOptions checkpointOptions;
+
+    for (int i = 4; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--transact-time") == 0) {
+            transactTime = true;
+        } else if (std::strcmp(argv[i], "--interval") == 0 && hasValue) {
+            intervalSeconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) {
+            threads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (!parseCheckpointOption(argc, argv, i, checkpointOptions)) {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "Aggregating..." << std::endl;
+
+    pcap::PcapParser parser(pcapFileName);
+    parser.open();
+    simba::BarAggregator aggregator(
+      static_cast<uint64_t>(intervalSeconds * 1e9), threads);
+
+    // Continue from the packet, output and aggregation state of the
+    // checkpoint
+    std::ofstream outFile;
+    pcap::Checkpoint checkpoint;
+    checkpoint.mode = pcap::CheckpointMode::Bars;
+    checkpoint.capture =
+      pcap::CaptureIdentity::of(pcapFileName, parser.getGlobalHeader());
+    if (!checkpointOptions.resumePath.empty()) {
+        const pcap::CaptureIdentity capture = checkpoint.capture;
+        checkpoint = pcap::Checkpoint::load(checkpointOptions.resumePath);
+        checkpoint.validate(
+          pcap::CheckpointMode::Bars, capture, outputFileName);
+        parser.seek(checkpoint.pcapOffset);
+        checkpoint.reopenOutput(outputFileName, outFile);
+        aggregator.restoreState(checkpoint.engineState);
+        std::cout << "Resuming after packet " << checkpoint.packets
+                  << std::endl;
+    } else {
+        outFile.open(outputFileName);
+        simba::BarAggregator::writeCSVHeader(outFile);
+    }
+    if (!outFile.is_open()) {
+        throw std::runtime_error("Error: Could not open output file.");
+    }
+
+    simba::DecodeStats stats;
+    pcap::PcapPacket packet;
+    while (parser.next(packet)) {
+        simba::SimbaDecoder decoder(packet.data);
+        decoder.decode();
+        stats += decoder.getStats();
+
+        // Executions are stamped with the capture time unless the
+        // exchange transact time is requested
+        const uint64_t timeNs = transactTime
+                                  ? decoder.getTransactTime()
+                                  : parser.timestampNs(packet.header);
+        for (const auto& execution : decoder.getOrderExecutions()) {
+            aggregator.add(execution, timeNs);
+        }
+
+        // Completed bars are written at fixed packet counts, independent of
+        // the checkpoint interval, so a resumed run writes the same file
+        checkpoint.recordPacket(packet);
+        if (++checkpoint.packets % BAR_WRITE_PACKETS == 0) {
+            aggregator.writeCompleted(outFile);
+        }
+        if (checkpointOptions.due(checkpoint.packets)) {
+            outFile.flush();
+            checkpoint.pcapOffset = parser.tell();
+            checkpoint.outputOffset = outFile.tellp();
+            aggregator.saveState(checkpoint.engineState);
+            checkpoint.save(checkpointOptions.path);
+        }
+    }
+    aggregator.finish();
+    aggregator.writeCompleted(outFile);
+    printDecodeStats(stats);
+
+    std::cout << "Bars have been successfully saved to " << outputFileName
+              << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Replay the capture to UDP multicast and report the achieved rate
+int runReplay(const int argc, const char* argv[])
+{
+    const std::string pcapFileName = argv[2];
+    pcap::ReplayConfig config;
+
+    for (int i = 3; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--max-rate") == 0) {
+            config.speed = 0;
+        } else if (std::strcmp(argv[i], "--no-loopback") == 0) {
+            config.loopback = false;
+        } else if (std::strcmp(argv[i], "--sleep") == 0) {
+            config.sleep = true;
+        } else if (std::strcmp(argv[i], "--speed") == 0 && hasValue) {
+            config.speed = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--group") == 0 && hasValue) {
+            config.groups.push_back(pcap::ReplayEndpoint::parse(argv[++i]));
+        } else if (std::strcmp(argv[i], "--interface") == 0 && hasValue) {
+            config.interfaceAddress =
+              pcap::ReplayEndpoint::parseAddress(argv[++i]);
+        } else if (std::strcmp(argv[i], "--ttl") == 0 && hasValue) {
+            config.ttl = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--batch") == 0 && hasValue) {
+            config.batchSize = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--loops") == 0 && hasValue) {
+            config.loops = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "Replaying..." << std::endl;
+
+    pcap::PcapReplayer replayer(pcapFileName, config);
+    const pcap::ReplayStats stats = replayer.replay();
+
+    std::cout << "Sent " << stats.packets << " packets (" << stats.bytes
+              << " bytes) in " << stats.elapsedSeconds << " s, "
+              << static_cast<uint64_t>(stats.packetsPerSecond())
+              << " packets/s, " << stats.sendErrors << " send errors"
+              << std::endl;
+    if (config.speed > 0) {
+        std::cout << "Pacing lateness: mean " << stats.meanLatenessNs
+                  << " ns, p99 " << stats.p99LatenessNs << " ns, max "
+                  << stats.maxLatenessNs << " ns" << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Stream buffer appending to a string, so one line buffer can be reused
+class StringAppendBuf : public std::streambuf
+{
+public:
+    explicit StringAppendBuf(std::string& target)
+      : target(target)
+    {
+    }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            target.push_back(traits_type::to_char_type(ch));
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize size) override
+    {
+        target.append(data, static_cast<size_t>(size));
+        return size;
+    }
+
+private:
+    std::string& target;
+};
+
+// Writes each decoded message as a JSON line to its shard, in wire order
+class ShardHandler : public simba::MessageHandler
+{
+public:
+    ShardHandler(pcap::ShardedWriter& writer, pcap::ShardKey key)
+      : writer(writer)
+      , key(key)
+      , buffer(line)
+      , out(&buffer)
+    {
+    }
+
+    // Group of the packet whose messages follow
+    void setGroupKey(uint64_t groupKey) noexcept { this->groupKey = groupKey; }
+
+    void onOrderUpdate(const simba::OrderUpdate& update) override
+    {
+        write(keyOf(update.security_id, simba::OrderUpdate::TEMPLATE_ID),
+              "orderUpdate",
+              update);
+    }
+
+    void onOrderExecution(const simba::OrderExecution& execution) override
+    {
+        write(keyOf(execution.security_id,
+                    simba::OrderExecution::TEMPLATE_ID),
+              "orderExecution",
+              execution);
+    }
+
+    void onOrderBookSnapshot(const simba::OrderBookSnapshot& snapshot) override
+    {
+        write(keyOf(snapshot.security_id,
+                    simba::OrderBookSnapshot::TEMPLATE_ID),
+              "orderBookSnapshot",
+              snapshot);
+    }
+
+private:
+    // Pick the shard of a message from its security_id and template
+    uint64_t keyOf(int32_t securityId, uint16_t templateId) const
+    {
+        switch (key) {
+            case pcap::ShardKey::SecurityId:
+                return writer.securityKey(securityId);
+            case pcap::ShardKey::Template:
+                return static_cast<uint64_t>(templateId);
+            default:
+                return groupKey;
+        }
+    }
+
+    template<typename Message>
+    void write(uint64_t shard, const char* type, const Message& message)
+    {
+        line.clear();
+        out << "{\"" << type << "\":";
+        simba::SimbaDecoder::writeJSON(out, message);
+        out << "}\n";
+        writer.append(shard, line);
+    }
+
+    pcap::ShardedWriter& writer;
+    pcap::ShardKey key;
+    uint64_t groupKey = 0;
+    std::string line;
+    StringAppendBuf buffer;
+    std::ostream out;
+};
+
+// Decode the capture into one file per security, template or group
+int runSharded(const int argc, const char* argv[])
+{
+    if (argc < 4) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const std::string pcapFileName = argv[2];
+    pcap::ShardOptions options;
+    options.directory = argv[3];
+
+    for (int i = 4; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--by") == 0 && hasValue) {
+            const std::string key = argv[++i];
+            if (key == "security") {
+                options.key = pcap::ShardKey::SecurityId;
+            } else if (key == "template") {
+                options.key = pcap::ShardKey::Template;
+            } else if (key == "group") {
+                options.key = pcap::ShardKey::Group;
+            } else {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (std::strcmp(argv[i], "--shards") == 0 && hasValue) {
+            options.shardCount = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--max-open") == 0 && hasValue) {
+            options.maxOpenFiles = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--flush-threads") == 0 && hasValue) {
+            options.flushThreads = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "Decoding..." << std::endl;
+
+    pcap::PcapParser parser(pcapFileName);
+    parser.open();
+    pcap::ShardedWriter writer(options);
+
+    ShardHandler handler(writer, options.key);
+    simba::DecodeStats stats;
+    pcap::PcapPacket packet;
+    while (parser.next(packet)) {
+        handler.setGroupKey(
+          pcap::ShardedWriter::groupKey(packet.ipHeader.destinationAddress,
+                                        packet.udpHeader.destinationPort));
+
+        simba::SimbaDecoder decoder(packet.data);
+        decoder.decode(handler);
+        stats += decoder.getStats();
+    }
+    writer.finish();
+    printDecodeStats(stats);
+
+    std::cout << "Decoded data has been successfully saved to "
+              << writer.shardCount() << " files in " << options.directory
+              << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Decode captures into a time-partitioned store for --query
+int runBuildStore(const int argc, const char* argv[])
+{
+    if (argc < 4) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const std::string directory = argv[2];
+    double partitionSeconds = 3600;
+    std::vector<std::string> pcapFileNames;
+
+    for (int i = 3; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--partition") == 0 && i + 1 < argc) {
+            partitionSeconds = std::atof(argv[++i]);
+        } else {
+            pcapFileNames.push_back(argv[i]);
+        }
+    }
+
+    simba::StoreBuilder builder(
+      directory, static_cast<uint64_t>(partitionSeconds * 1e9));
+    for (const auto& pcapFileName : pcapFileNames) {
+        std::cout << "Decoding " << pcapFileName << "..." << std::endl;
+        if (!builder.addCapture(pcapFileName)) {
+            std::cerr << "Warning: Skipped " << pcapFileName
+                      << ", the store already holds it." << std::endl;
+        }
+    }
+    builder.finish();
+    printDecodeStats(builder.getDecodeStats());
+
+    std::cout << "Store has been successfully saved to " << directory
+              << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Run one query and report its latency and partition pruning on stderr
+void runQuery(simba::TimeSeriesStore& store,
+              const std::string& text,
+              unsigned threads)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const simba::Query query = simba::Query::parse(text);
+    const simba::QueryResult result = store.run(query, threads);
+    result.write(std::cout, query);
+    std::cout.flush();
+
+    const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+    std::cerr << "Scanned " << result.partitionsScanned << " of "
+              << result.partitionsTotal << " partitions in "
+              << elapsed.count() << " ms" << std::endl;
+}
+
+// Answer a query, or every line of stdin against the same mapped store
+int runQueries(const int argc, const char* argv[])
+{
+    const std::string directory = argv[2];
+    std::string text;
+    unsigned threads = 0;
+
+    for (int i = 3; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (text.empty()) {
+            text = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    simba::TimeSeriesStore store(directory);
+    if (!text.empty()) {
+        runQuery(store, text, threads);
+        return EXIT_SUCCESS;
+    }
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        try {
+            runQuery(store, line, threads);
+        } catch (const std::runtime_error& ex) {
+            std::cerr << ex.what() << std::endl;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+} // namespace
 
 int main(const int argc, const char* argv[])
 {
     // Ensure correct number of arguments
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <pcap file path>"
-                  << " <output file path>" << std::endl;
+        printUsage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    // Capture the file paths from the command line arguments
-    const std::string pcapFileName = argv[1];
-    const std::string outputFileName = argv[2];
+    try {
+        if (std::strcmp(argv[1], "--replay") == 0) {
+            return runReplay(argc, argv);
+        }
+        if (std::strcmp(argv[1], "--bars") == 0) {
+            return runBars(argc, argv);
+        }
+        if (std::strcmp(argv[1], "--sharded") == 0) {
+            return runSharded(argc, argv);
+        }
+        if (std::strcmp(argv[1], "--build-store") == 0) {
+            return runBuildStore(argc, argv);
+        }
+        if (std::strcmp(argv[1], "--query") == 0) {
+            return runQueries(argc, argv);
+        }
 
-    std::cout << "Decoding..." << std::endl;
+        // Capture the file paths from the command line arguments
+        const std::string pcapFileName = argv[1];
+        const std::string outputFileName = argv[2];
+
+        pcap::CheckpointOptions checkpointOptions;
+        for (int i = 3; i < argc; ++i) {
+            if (!parseCheckpointOption(argc, argv, i, checkpointOptions)) {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+
+        std::cout << "Decoding..." << std::endl;
 
-    try {
         // Initialize the parser and start parsing
         pcap::PcapParser parser(pcapFileName, outputFileName);
-        parser.parse();
+        parser.parse(checkpointOptions);
+        printDecodeStats(parser.getDecodeStats());
 
         std::cout << "Decoded data has been successfully saved to "
                   << outputFileName << std::endl;
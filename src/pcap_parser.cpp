@@ -6,6 +6,13 @@
 
 namespace pcap {
 
+// Constructor for callers that only iterate over packets
+PcapParser::PcapParser(const std::string& filename)
+  : filename(filename)
+  , globalHeader{}
+{
+}
+
 // Constructor initializes the input and output filenames
 PcapParser::PcapParser(const std::string& filename,
                        const std::string& outputFile)
@@ -16,31 +23,98 @@ PcapParser::PcapParser(const std::string& filename,
 }
 
 // Main parse function to process the pcap file
-void PcapParser::parse()
+void PcapParser::parse(const CheckpointOptions& checkpointOptions)
 {
-    std::ifstream pcapFile(filename, std::ios::binary);
-    if (!pcapFile) {
-        throw std::runtime_error("Error: Could not open pcap file.");
+    open();
+
+    Checkpoint checkpoint;
+    checkpoint.mode = CheckpointMode::Json;
+    checkpoint.capture = CaptureIdentity::of(filename, globalHeader);
+    std::ofstream outFile;
+    if (!checkpointOptions.resumePath.empty()) {
+        const CaptureIdentity capture = checkpoint.capture;
+        checkpoint = Checkpoint::load(checkpointOptions.resumePath);
+        checkpoint.validate(CheckpointMode::Json, capture, outputFile);
+        seek(checkpoint.pcapOffset);
+        checkpoint.reopenOutput(outputFile, outFile);
+    } else {
+        outFile.open(outputFile);
     }
-
-    std::ofstream outFile(outputFile);
     if (!outFile.is_open()) {
         throw std::runtime_error("Error: Could not open output file.");
     }
 
-    // Parse the global header
-    globalHeader = parseGlobalHeader(pcapFile);
-
     // Read and parse packets until the end of the file
-    while (pcapFile.peek() != EOF) {
-        PcapPacket packet = parsePacket(pcapFile);
+    PcapPacket packet;
+    while (next(packet)) {
         saveDecodedPacket(packet, outFile);
+
+        checkpoint.recordPacket(packet);
+        if (checkpointOptions.due(++checkpoint.packets)) {
+            outFile.flush();
+            checkpoint.pcapOffset = tell();
+            checkpoint.outputOffset = outFile.tellp();
+            checkpoint.save(checkpointOptions.path);
+        }
     }
 
     outFile.close();
     pcapFile.close();
 }
 
+// Open the pcap file and parse the global header
+void PcapParser::open()
+{
+    // Read through a larger buffer than the stream default
+    readBuffer.resize(READ_BUFFER_SIZE);
+    pcapFile.rdbuf()->pubsetbuf(readBuffer.data(), readBuffer.size());
+    pcapFile.open(filename, std::ios::binary);
+    if (!pcapFile) {
+        throw std::runtime_error("Error: Could not open pcap file.");
+    }
+
+    globalHeader = parseGlobalHeader(pcapFile);
+}
+
+// Read the next packet from the pcap file
+bool PcapParser::next(PcapPacket& packet)
+{
+    if (pcapFile.peek() == EOF) {
+        return false;
+    }
+    parsePacket(pcapFile, packet);
+    return true;
+}
+
+// Offset of the next packet in the pcap file
+uint64_t PcapParser::tell()
+{
+    return static_cast<uint64_t>(pcapFile.tellg());
+}
+
+// Continue reading from a packet offset previously returned by tell()
+void PcapParser::seek(uint64_t offset)
+{
+    if (offset < PcapGlobalHeader::SIZE) {
+        throw std::runtime_error("Error: Invalid pcap offset.");
+    }
+    pcapFile.clear();
+    pcapFile.seekg(static_cast<std::streamoff>(offset));
+    if (!pcapFile) {
+        throw std::runtime_error("Error seeking in pcap file.");
+    }
+}
+
+// Convert the packet timestamp to nanoseconds since the epoch
+uint64_t PcapParser::timestampNs(const PcapPacketHeader& header) const noexcept
+{
+    const uint64_t fraction =
+      globalHeader.magic_number == PcapGlobalHeader::MAGIC_NANOSECONDS
+        ? header.ts_usec
+        : static_cast<uint64_t>(header.ts_usec) * 1000;
+    return static_cast<uint64_t>(header.ts_sec) * 1000000000ULL + fraction;
+}
+
 // Parse the global header from the pcap file
 PcapGlobalHeader PcapParser::parseGlobalHeader(std::ifstream& file)
 {
@@ -52,11 +126,10 @@ PcapGlobalHeader PcapParser::parseGlobalHeader(std::ifstream& file)
     return header;
 }
 
-// Parse a single packet from the pcap file
-PcapPacket PcapParser::parsePacket(std::ifstream& file)
+// Parse a single packet from the pcap file into an existing packet, reusing
+// its payload storage
+void PcapParser::parsePacket(std::ifstream& file, PcapPacket& packet)
 {
-    PcapPacket packet;
-
     // Read the packet header
     file.read(reinterpret_cast<char*>(&packet.header), PcapPacketHeader::SIZE);
     if (!file) {
@@ -80,8 +153,6 @@ PcapPacket PcapParser::parsePacket(std::ifstream& file)
     if (!file) {
         throw std::runtime_error("Error reading packet data.");
     }
-
-    return packet;
 }
 
 // Parse the Ethernet header from the packet
@@ -134,6 +205,7 @@ void PcapParser::saveDecodedPacket(const PcapPacket& packet,
 {
     simba::SimbaDecoder decoder(packet.data);
     decoder.decode();
+    decodeStats += decoder.getStats();
     std::string jsonOutput = decoder.toJSON();
     outFile << jsonOutput << std::endl;
 }
@@ -0,0 +1,352 @@
+#include "../include/pcap_replayer.hpp"
+#include "../include/pcap_parser.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <arpa/inet.h>  // For inet_pton and byte order functions
+#include <netinet/in.h> // For sockaddr_in and IP_MULTICAST_* options
+#include <sys/socket.h> // For sendmmsg
+#include <sys/stat.h>   // For stat
+#include <unistd.h>     // For close
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // For __rdtsc and _mm_pause
+#define PCAP_REPLAY_HAS_TSC 1
+#endif
+
+namespace pcap {
+
+namespace {
+
+// Lateness histogram resolution, samples above the last bucket only count
+// towards the maximum
+constexpr uint64_t HISTOGRAM_BUCKET_NS = 100;
+constexpr size_t HISTOGRAM_BUCKETS = 10000;
+
+// With sleeping enabled, long waits sleep until this long before the
+// deadline and busy-spin the rest, leaving room for late wake-ups
+constexpr uint64_t SLEEP_MARGIN_NS = 2000000;
+
+uint64_t steadyNs() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Clock used for pacing. On x86 it reads the TSC, which is far cheaper than
+// a clock_gettime call inside the spin loop, scaled by a ratio calibrated
+// against steady_clock. Elsewhere it falls back to steady_clock.
+class SpinClock
+{
+public:
+    SpinClock()
+      : baseNs(steadyNs())
+#ifdef PCAP_REPLAY_HAS_TSC
+      , baseTicks(__rdtsc())
+      , nsPerTick(1.0)
+#endif
+    {
+#ifdef PCAP_REPLAY_HAS_TSC
+        // Calibrate over a short busy window
+        uint64_t endNs = baseNs;
+        while (endNs - baseNs < 20000000) {
+            endNs = steadyNs();
+        }
+        const uint64_t endTicks = __rdtsc();
+        nsPerTick =
+          static_cast<double>(endNs - baseNs) / (endTicks - baseTicks);
+#endif
+    }
+
+    uint64_t nowNs() const noexcept
+    {
+#ifdef PCAP_REPLAY_HAS_TSC
+        return baseNs +
+               static_cast<uint64_t>((__rdtsc() - baseTicks) * nsPerTick);
+#else
+        return steadyNs();
+#endif
+    }
+
+    // Busy-spin until the given time, optionally sleeping through the
+    // start of long gaps
+    void waitUntil(uint64_t deadlineNs, bool sleep) const
+    {
+        const uint64_t now = nowNs();
+        if (sleep && deadlineNs > now + 2 * SLEEP_MARGIN_NS) {
+            std::this_thread::sleep_for(
+              std::chrono::nanoseconds(deadlineNs - now - SLEEP_MARGIN_NS));
+        }
+        while (nowNs() < deadlineNs) {
+#ifdef PCAP_REPLAY_HAS_TSC
+            _mm_pause();
+#endif
+        }
+    }
+
+private:
+    uint64_t baseNs;
+#ifdef PCAP_REPLAY_HAS_TSC
+    uint64_t baseTicks;
+    double nsPerTick;
+#endif
+};
+
+} // namespace
+
+// Parse an "a.b.c.d:port" endpoint
+ReplayEndpoint ReplayEndpoint::parse(const std::string& text)
+{
+    const size_t colon = text.rfind(':');
+    if (colon == std::string::npos) {
+        throw std::runtime_error("Error: Endpoint must be <ip>:<port>: " +
+                                 text);
+    }
+
+    ReplayEndpoint endpoint{};
+    endpoint.address = parseAddress(text.substr(0, colon));
+
+    const unsigned long port =
+      std::strtoul(text.c_str() + colon + 1, nullptr, 10);
+    if (port == 0 || port > 65535) {
+        throw std::runtime_error("Error: Invalid UDP port: " + text);
+    }
+    endpoint.port = htons(static_cast<uint16_t>(port));
+    return endpoint;
+}
+
+// Parse a dotted IPv4 address
+uint32_t ReplayEndpoint::parseAddress(const std::string& text)
+{
+    in_addr address{};
+    if (inet_pton(AF_INET, text.c_str(), &address) != 1) {
+        throw std::runtime_error("Error: Invalid IPv4 address: " + text);
+    }
+    return address.s_addr;
+}
+
+// Constructor stores the capture path and replay settings
+PcapReplayer::PcapReplayer(const std::string& filename,
+                           const ReplayConfig& config)
+  : filename(filename)
+  , config(config)
+{
+}
+
+// Read every UDP payload into one contiguous buffer so that the send loop
+// never touches the file
+void PcapReplayer::load()
+{
+    PcapParser parser(filename);
+    parser.open();
+
+    payloads.clear();
+    frames.clear();
+    destinations.clear();
+
+    // The payloads are a subset of the file, so one allocation holds them
+    struct stat info;
+    if (::stat(filename.c_str(), &info) == 0 && info.st_size > 0) {
+        payloads.reserve(static_cast<size_t>(info.st_size));
+    }
+
+    // Captured destination (address << 16 | port) to destination index
+    std::map<uint64_t, uint32_t> feeds;
+    uint64_t firstTimestampNs = 0;
+
+    PcapPacket packet;
+    while (parser.next(packet)) {
+        if (packet.ipHeader.protocol != IPPROTO_UDP || packet.data.empty()) {
+            continue;
+        }
+
+        const uint64_t feed =
+          (static_cast<uint64_t>(packet.ipHeader.destinationAddress) << 16) |
+          packet.udpHeader.destinationPort;
+        auto it = feeds.find(feed);
+        if (it == feeds.end()) {
+            const uint32_t index = static_cast<uint32_t>(feeds.size());
+            ReplayEndpoint captured{ packet.ipHeader.destinationAddress,
+                                     packet.udpHeader.destinationPort };
+            destinations.push_back(
+              config.groups.empty()
+                ? captured
+                : config.groups[index % config.groups.size()]);
+            it = feeds.emplace(feed, index).first;
+        }
+
+        const uint64_t timestampNs = parser.timestampNs(packet.header);
+        if (frames.empty()) {
+            firstTimestampNs = timestampNs;
+        }
+
+        Frame frame;
+        frame.timestampNs = timestampNs > firstTimestampNs
+                              ? timestampNs - firstTimestampNs
+                              : 0;
+        frame.offset = payloads.size();
+        frame.length = static_cast<uint32_t>(packet.data.size());
+        frame.destination = it->second;
+        frames.push_back(frame);
+
+        payloads.insert(
+          payloads.end(), packet.data.begin(), packet.data.end());
+    }
+}
+
+// Create the UDP socket used for sending
+int PcapReplayer::openSocket() const
+{
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Error: Could not create UDP socket.");
+    }
+
+    const unsigned char ttl = static_cast<unsigned char>(config.ttl);
+    const unsigned char loop = config.loopback ? 1 : 0;
+    in_addr interfaceAddress{};
+    interfaceAddress.s_addr = config.interfaceAddress;
+    const int sendBuffer = 8 * 1024 * 1024;
+
+    if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) <
+          0 ||
+        setsockopt(fd,
+                   IPPROTO_IP,
+                   IP_MULTICAST_IF,
+                   &interfaceAddress,
+                   sizeof(interfaceAddress)) < 0) {
+        close(fd);
+        throw std::runtime_error("Error: Could not configure UDP socket.");
+    }
+
+    // A larger send buffer is best effort only
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+    return fd;
+}
+
+// Send the capture, pacing against the pcap timestamps unless running at
+// maximum rate
+ReplayStats PcapReplayer::replay()
+{
+    load();
+    const int fd = openSocket();
+
+    std::vector<sockaddr_in> addresses(destinations.size());
+    for (size_t i = 0; i < destinations.size(); ++i) {
+        std::memset(&addresses[i], 0, sizeof(sockaddr_in));
+        addresses[i].sin_family = AF_INET;
+        addresses[i].sin_addr.s_addr = destinations[i].address;
+        addresses[i].sin_port = destinations[i].port;
+    }
+
+    const size_t batchSize = std::max<size_t>(1, config.batchSize);
+    std::vector<mmsghdr> messages(batchSize);
+    std::vector<iovec> vectors(batchSize);
+    std::vector<uint64_t> histogram(HISTOGRAM_BUCKETS);
+    std::memset(messages.data(), 0, messages.size() * sizeof(mmsghdr));
+
+    const bool paced = config.speed > 0;
+    const uint64_t span = frames.empty() ? 0 : frames.back().timestampNs;
+    const SpinClock clock;
+
+    ReplayStats stats;
+    uint64_t latenessTotal = 0;
+    uint64_t latenessSamples = 0;
+    size_t pending = 0;
+
+    // Send the pending batch, retrying partial sends
+    auto flush = [&]() {
+        size_t sent = 0;
+        while (sent < pending) {
+            const int rc = sendmmsg(
+              fd, &messages[sent], static_cast<unsigned>(pending - sent), 0);
+            if (rc < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == ENOBUFS) {
+                    continue;
+                }
+                // Drop the datagram that failed and carry on with the rest
+                ++stats.sendErrors;
+                ++sent;
+                continue;
+            }
+            for (int i = 0; i < rc; ++i) {
+                stats.bytes += messages[sent + i].msg_hdr.msg_iov->iov_len;
+            }
+            stats.packets += rc;
+            sent += rc;
+        }
+        pending = 0;
+    };
+
+    const uint64_t startNs = clock.nowNs();
+    for (unsigned loop = 0; loop < config.loops; ++loop) {
+        for (const Frame& frame : frames) {
+            uint64_t dueNs = 0;
+            if (paced) {
+                dueNs = startNs + static_cast<uint64_t>(
+                                    (static_cast<double>(loop) * span +
+                                     frame.timestampNs) /
+                                    config.speed);
+                if (clock.nowNs() < dueNs) {
+                    // Nothing else is due yet, send what we have and wait
+                    flush();
+                    clock.waitUntil(dueNs, config.sleep);
+                }
+
+                // Stamp the datagram as it is handed to the batch
+                const uint64_t now = clock.nowNs();
+                const uint64_t lateness = now > dueNs ? now - dueNs : 0;
+                latenessTotal += lateness;
+                ++latenessSamples;
+                stats.maxLatenessNs = std::max(stats.maxLatenessNs, lateness);
+                const uint64_t bucket = lateness / HISTOGRAM_BUCKET_NS;
+                if (bucket < HISTOGRAM_BUCKETS) {
+                    ++histogram[bucket];
+                }
+            }
+
+            vectors[pending].iov_base = &payloads[frame.offset];
+            vectors[pending].iov_len = frame.length;
+            msghdr& header = messages[pending].msg_hdr;
+            header.msg_name = &addresses[frame.destination];
+            header.msg_namelen = sizeof(sockaddr_in);
+            header.msg_iov = &vectors[pending];
+            header.msg_iovlen = 1;
+
+            if (++pending == batchSize) {
+                flush();
+            }
+        }
+    }
+    flush();
+
+    stats.elapsedSeconds = (clock.nowNs() - startNs) / 1e9;
+    close(fd);
+
+    // Summarise pacing lateness
+    const uint64_t samples = latenessSamples;
+    if (samples > 0) {
+        stats.meanLatenessNs = latenessTotal / samples;
+        const uint64_t target = samples - samples / 100;
+        uint64_t seen = 0;
+        stats.p99LatenessNs = stats.maxLatenessNs;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+            seen += histogram[i];
+            if (seen >= target) {
+                stats.p99LatenessNs = (i + 1) * HISTOGRAM_BUCKET_NS;
+                break;
+            }
+        }
+    }
+
+    return stats;
+}
+
+} // namespace pcap
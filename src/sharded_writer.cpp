@@ -0,0 +1,275 @@
+#include "../include/sharded_writer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <arpa/inet.h> // For inet_ntop and byte order functions
+#include <fcntl.h>     // For open
+#include <unistd.h>    // For write and close
+
+namespace pcap {
+
+namespace {
+
+// Queued bytes across all shards before append() waits for the writers
+constexpr size_t MAX_QUEUED_BYTES = 256 * 1024 * 1024;
+
+} // namespace
+
+// Constructor starts the flush threads
+ShardedWriter::ShardedWriter(const ShardOptions& options)
+  : options(options)
+{
+    if (this->options.maxOpenFiles == 0) {
+        this->options.maxOpenFiles = 1;
+    }
+    // Each writing thread holds a descriptor, so more threads than
+    // descriptors would leave no idle file to close in openFile()
+    const unsigned count = static_cast<unsigned>(std::min<size_t>(
+      std::max(1u, options.flushThreads), this->options.maxOpenFiles));
+    for (unsigned i = 0; i < count; ++i) {
+        threads.emplace_back([this]() { run(); });
+    }
+}
+
+// Destructor flushes whatever is left
+ShardedWriter::~ShardedWriter()
+{
+    if (!finished) {
+        try {
+            finish();
+        } catch (const std::exception&) {
+            // Errors can only be reported by an explicit finish()
+        }
+    }
+}
+
+// Map a security_id to its shard key
+uint64_t ShardedWriter::securityKey(int32_t securityId) const noexcept
+{
+    const uint32_t id = static_cast<uint32_t>(securityId);
+    return options.shardCount == 0 ? id : id % options.shardCount;
+}
+
+// Name of the file backing a shard
+std::string ShardedWriter::fileName(uint64_t key) const
+{
+    std::string name;
+    switch (options.key) {
+        case ShardKey::SecurityId:
+            name = (options.shardCount == 0 ? "security_" : "security_shard_") +
+                   std::to_string(key);
+            break;
+        case ShardKey::Template:
+            name = "template_" + std::to_string(key);
+            break;
+        case ShardKey::Group: {
+            in_addr address{};
+            address.s_addr = static_cast<uint32_t>(key >> 16);
+            char text[INET_ADDRSTRLEN] = {};
+            inet_ntop(AF_INET, &address, text, sizeof(text));
+            name = std::string("group_") + text + "_" +
+                   std::to_string(ntohs(static_cast<uint16_t>(key)));
+            break;
+        }
+    }
+    return options.directory + "/" + name + ".json";
+}
+
+// Buffer data for a shard and queue the buffer once it is full, or queue the
+// least recently appended buffer once all of them hold too much
+void ShardedWriter::append(uint64_t key, const std::string& data)
+{
+    std::unique_ptr<Shard>& slot = shards[key];
+    if (!slot) {
+        slot.reset(new Shard);
+        slot->path = fileName(key);
+    }
+
+    Shard& shard = *slot;
+    if (data.empty()) {
+        return;
+    }
+    if (shard.buffer.empty()) {
+        buffered.push_front(&shard);
+        shard.appended = buffered.begin();
+    } else {
+        buffered.splice(buffered.begin(), buffered, shard.appended);
+    }
+    shard.buffer += data;
+    bufferedBytes += data.size();
+
+    if (shard.buffer.size() >= options.bufferSize) {
+        enqueue(shard);
+    }
+    while (bufferedBytes > options.maxBufferedBytes) {
+        enqueue(*buffered.back());
+    }
+}
+
+// Hand the shard's buffer to the flush threads. The buffer grows again from
+// empty, so idle shards hold no memory.
+void ShardedWriter::enqueue(Shard& shard)
+{
+    std::string chunk;
+    chunk.swap(shard.buffer);
+    bufferedBytes -= chunk.size();
+    buffered.erase(shard.appended);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    spaceReady.wait(lock, [this]() {
+        return queuedBytes < MAX_QUEUED_BYTES || !error.empty();
+    });
+    queuedBytes += chunk.size();
+    shard.chunks.push_back(std::move(chunk));
+
+    // A shard is in the work queue at most once so that its chunks are
+    // always written by one thread, in order
+    if (!shard.scheduled && !shard.writing) {
+        shard.scheduled = true;
+        work.push_back(&shard);
+        workReady.notify_one();
+    }
+}
+
+// Flush everything and join the threads
+void ShardedWriter::finish()
+{
+    for (auto& entry : shards) {
+        if (!entry.second->buffer.empty()) {
+            enqueue(*entry.second);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    workReady.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+
+    for (Shard* shard : openFiles) {
+        close(shard->fd);
+        shard->fd = -1;
+    }
+    openFiles.clear();
+    finished = true;
+
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+}
+
+// Flush thread loop: write the queued chunks of one shard at a time
+void ShardedWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        workReady.wait(lock, [this]() { return stopping || !work.empty(); });
+        if (work.empty()) {
+            return;
+        }
+
+        Shard& shard = *work.front();
+        work.pop_front();
+        shard.scheduled = false;
+        shard.writing = true;
+
+        std::deque<std::string> chunks;
+        chunks.swap(shard.chunks);
+        if (shard.fd < 0) {
+            openFile(shard, lock);
+        } else {
+            // Mark as most recently used
+            openFiles.splice(openFiles.begin(), openFiles, shard.lru);
+        }
+
+        lock.unlock();
+        writeChunks(shard, chunks);
+        lock.lock();
+
+        shard.writing = false;
+        for (const auto& chunk : chunks) {
+            queuedBytes -= chunk.size();
+        }
+        spaceReady.notify_all();
+
+        // More chunks may have arrived while writing
+        if (!shard.chunks.empty()) {
+            shard.scheduled = true;
+            work.push_back(&shard);
+            workReady.notify_one();
+        }
+    }
+}
+
+// Open the shard's file, closing the least recently used idle files to stay
+// within the descriptor budget. Called with the mutex held. There are no more
+// flush threads than descriptors, so an idle file is always left to close.
+void ShardedWriter::openFile(Shard& shard, std::unique_lock<std::mutex>& lock)
+{
+    auto victim = openFiles.end();
+    while (openFiles.size() + openingFiles >= options.maxOpenFiles &&
+           victim != openFiles.begin()) {
+        --victim;
+        Shard& idle = **victim;
+        if (idle.writing) {
+            continue;
+        }
+        close(idle.fd);
+        idle.fd = -1;
+        victim = openFiles.erase(victim);
+    }
+
+    const int flags =
+      O_WRONLY | O_CREAT | O_CLOEXEC | (shard.created ? O_APPEND : O_TRUNC);
+    ++openingFiles; // Holds the slot while the mutex is released
+    lock.unlock();
+    const int fd = ::open(shard.path.c_str(), flags, 0644);
+    lock.lock();
+    --openingFiles;
+
+    if (fd < 0) {
+        if (error.empty()) {
+            error = "Error: Could not open output file " + shard.path + ": " +
+                    std::strerror(errno);
+        }
+        return;
+    }
+    shard.fd = fd;
+    shard.created = true;
+    openFiles.push_front(&shard);
+    shard.lru = openFiles.begin();
+}
+
+// Write chunks to the shard's file, called without the mutex held
+void ShardedWriter::writeChunks(Shard& shard, std::deque<std::string>& chunks)
+{
+    if (shard.fd < 0) {
+        return;
+    }
+    for (const auto& chunk : chunks) {
+        size_t written = 0;
+        while (written < chunk.size()) {
+            const ssize_t rc =
+              ::write(shard.fd, chunk.data() + written, chunk.size() - written);
+            if (rc < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                if (error.empty()) {
+                    error = "Error writing output file " + shard.path + ": " +
+                            std::strerror(errno);
+                }
+                return;
+            }
+            written += static_cast<size_t>(rc);
+        }
+    }
+}
+
+} // namespace pcap
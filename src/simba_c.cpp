@@ -0,0 +1,141 @@
+#include "../include/simba_c.h"
+#include "../include/pcap_parser.hpp"
+#include "../include/simba_decoder.hpp"
+#include <cstddef>
+#include <exception>
+#include <string>
+#include <vector>
+
+// The C structs are reinterpreted as their C++ counterparts, so their
+// layouts must match exactly
+static_assert(sizeof(simba_packet) == sizeof(simba::PacketView) &&
+                offsetof(simba_packet, destination_port) ==
+                  offsetof(simba::PacketView, destination_port),
+              "simba_packet layout mismatch!");
+static_assert(sizeof(simba_order_update_record) ==
+                  sizeof(simba::OrderUpdateRecord) &&
+                offsetof(simba_order_update_record, md_entry_type) ==
+                  offsetof(simba::OrderUpdateRecord, md_entry_type),
+              "simba_order_update_record layout mismatch!");
+static_assert(sizeof(simba_order_execution_record) ==
+                  sizeof(simba::OrderExecutionRecord) &&
+                offsetof(simba_order_execution_record, md_entry_type) ==
+                  offsetof(simba::OrderExecutionRecord, md_entry_type),
+              "simba_order_execution_record layout mismatch!");
+static_assert(sizeof(simba_snapshot_entry_record) ==
+                  sizeof(simba::SnapshotEntryRecord) &&
+                offsetof(simba_snapshot_entry_record, md_entry_type) ==
+                  offsetof(simba::SnapshotEntryRecord, md_entry_type),
+              "simba_snapshot_entry_record layout mismatch!");
+static_assert(sizeof(simba_decode_stats) == sizeof(simba::DecodeStats) &&
+                offsetof(simba_decode_stats, unknown_templates) ==
+                  offsetof(simba::DecodeStats, unknownTemplates),
+              "simba_decode_stats layout mismatch!");
+static_assert(sizeof(simba_batch) == sizeof(simba::DecodeBuffers) &&
+                offsetof(simba_batch, stats) ==
+                  offsetof(simba::DecodeBuffers, stats) &&
+                offsetof(simba_batch, snapshot_entries_count) ==
+                  offsetof(simba::DecodeBuffers, snapshotEntriesCount),
+              "simba_batch layout mismatch!");
+
+// Reader state behind the opaque handle
+struct simba_pcap
+{
+    explicit simba_pcap(const char* path)
+      : parser(path)
+    {
+    }
+
+    pcap::PcapParser parser;
+    std::vector<pcap::PcapPacket> packets; // Reused across batches
+};
+
+namespace {
+
+thread_local std::string lastError;
+
+void setError(const std::exception& ex)
+{
+    lastError = ex.what();
+}
+
+} // namespace
+
+extern "C" {
+
+int simba_abi_version(void)
+{
+    return SIMBA_ABI_VERSION;
+}
+
+const char* simba_last_error(void)
+{
+    return lastError.c_str();
+}
+
+simba_pcap* simba_pcap_open(const char* path)
+{
+    lastError.clear();
+    simba_pcap* pcap = nullptr;
+    try {
+        pcap = new simba_pcap(path);
+        pcap->parser.open();
+        return pcap;
+    } catch (const std::exception& ex) {
+        setError(ex);
+        delete pcap;
+        return nullptr;
+    }
+}
+
+size_t simba_pcap_next_batch(simba_pcap* pcap,
+                             simba_packet* packets,
+                             size_t capacity)
+{
+    lastError.clear();
+    size_t count = 0;
+    try {
+        if (pcap->packets.size() < capacity) {
+            pcap->packets.resize(capacity);
+        }
+
+        while (count < capacity && pcap->parser.next(pcap->packets[count])) {
+            const pcap::PcapPacket& packet = pcap->packets[count];
+            simba_packet& view = packets[count];
+            view.data = packet.data.data();
+            view.size = packet.data.size();
+            view.timestamp_ns = pcap->parser.timestampNs(packet.header);
+            view.destination_address = packet.ipHeader.destinationAddress;
+            view.destination_port = packet.udpHeader.destinationPort;
+            ++count;
+        }
+        return count;
+    } catch (const std::exception& ex) {
+        // The packets read before the failure are still valid
+        setError(ex);
+        return count;
+    }
+}
+
+void simba_pcap_close(simba_pcap* pcap)
+{
+    delete pcap;
+}
+
+size_t simba_decode_batch(const simba_packet* packets,
+                          size_t count,
+                          simba_batch* batch)
+{
+    lastError.clear();
+    try {
+        return simba::SimbaDecoder::decodeBatch(
+          reinterpret_cast<const simba::PacketView*>(packets),
+          count,
+          *reinterpret_cast<simba::DecodeBuffers*>(batch));
+    } catch (const std::exception& ex) {
+        setError(ex);
+        return 0;
+    }
+}
+
+} // extern "C"
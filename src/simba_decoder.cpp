@@ -3,59 +3,394 @@
 #include <sstream>
 #include <cstring>
 #include <iomanip>
+#include <stdexcept>
 
 namespace simba {
 
 // Constructor: Initialize the packet data reference
 SimbaDecoder::SimbaDecoder(const std::vector<uint8_t>& packetData)
-  : packetData(packetData)
+  : SimbaDecoder(packetData.data(), packetData.size())
 {
 }
 
-// Main decode function that processes the entire packet data
-void SimbaDecoder::decode()
+// Constructor for packet data that is not held in a vector
+SimbaDecoder::SimbaDecoder(const uint8_t* data, size_t size)
+  : packetData(data)
+  , packetSize(size)
+  , marketDataPacketHeader{}
+  , incrementalPacketHeader{}
+{
+}
+
+namespace {
+
+// Copy each entry individually, the group block may be longer than the
+// fields we know
+void copyEntries(OrderBookSnapshot& snapshot,
+                 const uint8_t* entries,
+                 size_t stride)
+{
+    snapshot.entries.resize(snapshot.no_md_entries.num_in_group);
+    for (auto& entry : snapshot.entries) {
+        std::memcpy(&entry, entries, OrderBookSnapshot::Entry::SIZE);
+        entries += stride;
+    }
+}
+
+// Sink collecting the messages into the decoder's vectors
+struct VectorSink
+{
+    std::vector<OrderUpdate>& orderUpdates;
+    std::vector<OrderExecution>& orderExecutions;
+    std::vector<OrderBookSnapshot>& orderBookSnapshots;
+
+    bool onOrderUpdate(const OrderUpdate& update)
+    {
+        orderUpdates.emplace_back(update);
+        return true;
+    }
+
+    bool onOrderExecution(const OrderExecution& execution)
+    {
+        orderExecutions.emplace_back(execution);
+        return true;
+    }
+
+    bool onOrderBookSnapshot(OrderBookSnapshot& snapshot,
+                             const uint8_t* entries,
+                             size_t stride)
+    {
+        copyEntries(snapshot, entries, stride);
+        orderBookSnapshots.emplace_back(std::move(snapshot));
+        return true;
+    }
+};
+
+// Sink forwarding each message to a caller's handler
+struct HandlerSink
+{
+    MessageHandler& handler;
+
+    bool onOrderUpdate(const OrderUpdate& update)
+    {
+        handler.onOrderUpdate(update);
+        return true;
+    }
+
+    bool onOrderExecution(const OrderExecution& execution)
+    {
+        handler.onOrderExecution(execution);
+        return true;
+    }
+
+    bool onOrderBookSnapshot(OrderBookSnapshot& snapshot,
+                             const uint8_t* entries,
+                             size_t stride)
+    {
+        copyEntries(snapshot, entries, stride);
+        handler.onOrderBookSnapshot(snapshot);
+        return true;
+    }
+};
+
+// Sink writing flat records into the caller's batch buffers. Message types
+// whose array is NULL or has no capacity are skipped.
+struct BatchSink
+{
+    DecodeBuffers& buffers;
+    const MarketDataPacketHeader& packetHeader;
+    const IncrementalPacketHeader& incrementalHeader;
+    uint32_t packetIndex;
+    const char* full; // Name of the array that ran out of capacity
+
+    bool onOrderUpdate(const OrderUpdate& update)
+    {
+        if (buffers.orderUpdates == nullptr ||
+            buffers.orderUpdatesCapacity == 0) {
+            return true;
+        }
+        if (buffers.orderUpdatesCount == buffers.orderUpdatesCapacity) {
+            full = "order_updates";
+            return false;
+        }
+        OrderUpdateRecord& record =
+          buffers.orderUpdates[buffers.orderUpdatesCount++];
+        record.packet_index = packetIndex;
+        record.msg_seq_num = packetHeader.msg_seq_num;
+        record.transact_time = incrementalHeader.transact_time;
+        record.md_entry_id = update.md_entry_id;
+        record.md_entry_px = update.md_entry_px.mantissa;
+        record.md_entry_size = update.md_entry_size;
+        record.md_flags = static_cast<uint64_t>(update.md_flags);
+        record.md_flags2 = update.md_flags2;
+        record.security_id = update.security_id;
+        record.rpt_seq = update.rpt_seq;
+        record.md_update_action =
+          static_cast<uint8_t>(update.md_update_action);
+        record.md_entry_type = static_cast<char>(update.md_entry_type);
+        return true;
+    }
+
+    bool onOrderExecution(const OrderExecution& execution)
+    {
+        if (buffers.orderExecutions == nullptr ||
+            buffers.orderExecutionsCapacity == 0) {
+            return true;
+        }
+        if (buffers.orderExecutionsCount == buffers.orderExecutionsCapacity) {
+            full = "order_executions";
+            return false;
+        }
+        OrderExecutionRecord& record =
+          buffers.orderExecutions[buffers.orderExecutionsCount++];
+        record.packet_index = packetIndex;
+        record.msg_seq_num = packetHeader.msg_seq_num;
+        record.transact_time = incrementalHeader.transact_time;
+        record.md_entry_id = execution.md_entry_id;
+        record.md_entry_px = execution.md_entry_px.mantissa;
+        record.md_entry_size = execution.md_entry_size;
+        record.last_px = execution.last_px.mantissa;
+        record.last_qty = execution.last_qty;
+        record.trade_id = execution.trade_id;
+        record.md_flags = static_cast<uint64_t>(execution.md_flags);
+        record.md_flags2 = execution.md_flags2;
+        record.security_id = execution.security_id;
+        record.rpt_seq = execution.rpt_seq;
+        record.md_update_action =
+          static_cast<uint8_t>(execution.md_update_action);
+        record.md_entry_type = static_cast<char>(execution.md_entry_type);
+        return true;
+    }
+
+    bool onOrderBookSnapshot(const OrderBookSnapshot& snapshot,
+                             const uint8_t* entries,
+                             size_t stride)
+    {
+        const size_t count = snapshot.no_md_entries.num_in_group;
+        if (buffers.snapshotEntries == nullptr ||
+            buffers.snapshotEntriesCapacity == 0) {
+            return true;
+        }
+        if (buffers.snapshotEntriesCapacity - buffers.snapshotEntriesCount <
+            count) {
+            full = "snapshot_entries";
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i, entries += stride) {
+            OrderBookSnapshot::Entry entry;
+            std::memcpy(&entry, entries, OrderBookSnapshot::Entry::SIZE);
+
+            SnapshotEntryRecord& record =
+              buffers.snapshotEntries[buffers.snapshotEntriesCount++];
+            record.packet_index = packetIndex;
+            record.msg_seq_num = packetHeader.msg_seq_num;
+            record.security_id = snapshot.security_id;
+            record.last_msg_seq_num_processed =
+              snapshot.last_msg_seq_num_processed;
+            record.rpt_seq = snapshot.rpt_seq;
+            record.exchange_trading_session_id =
+              snapshot.exchange_trading_session_id;
+            record.md_entry_id = entry.md_entry_id;
+            record.transact_time = entry.transact_time;
+            record.md_entry_px = entry.md_entry_px.mantissa;
+            record.md_entry_size = entry.md_entry_size;
+            record.trade_id = entry.trade_id;
+            record.md_flags = static_cast<uint64_t>(entry.md_flags);
+            record.md_flags2 = entry.md_flags2;
+            record.md_entry_type = static_cast<char>(entry.md_entry_type);
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+// Walk the packet. Each length field is checked once against the bytes
+// that remain before msg_size, so the per-message decoders can copy without
+// further checks. Known messages advance by their block_length, which may
+// exceed the fields we decode in newer schema versions.
+template<typename Sink>
+bool SimbaDecoder::walk(Sink& sink)
 {
     size_t offset = 0;
 
-    // Step 1: Parse Market Data Packet Header
-    MarketDataPacketHeader marketDataPacketHeader =
-      parseMarketDataPacketHeader(offset);
+    // Step 1: Parse Market Data Packet Header and bound the packet by
+    // msg_size
+    if (packetSize < MarketDataPacketHeader::SIZE) {
+        ++stats.truncatedPackets;
+        return true;
+    }
+    marketDataPacketHeader = parseMarketDataPacketHeader(offset);
+    const size_t end = marketDataPacketHeader.msg_size;
+    if (end > packetSize || end < offset) {
+        ++stats.truncatedPackets;
+        return true;
+    }
 
     // Step 2: If it's an Incremental Packet, parse the Incremental Packet
     // Header
     if (marketDataPacketHeader.IsIncremental()) {
-        IncrementalPacketHeader incrementalPacketHeader =
-          parseIncrementalPacketHeader(offset);
+        if (end - offset < IncrementalPacketHeader::SIZE) {
+            ++stats.truncatedPackets;
+            return true;
+        }
+        incrementalPacketHeader = parseIncrementalPacketHeader(offset);
     }
+    ++stats.packets;
+
+    // Step 3: Parse SBE Messages until the end of the packet
+    while (offset < end) {
+        if (end - offset < SBEHeader::SIZE) {
+            ++stats.truncatedMessages;
+            break;
+        }
+        const SBEHeader header = parseSBEHeader(offset);
+        if (end - offset < header.block_length) {
+            ++stats.truncatedMessages;
+            break;
+        }
+        size_t next = offset + header.block_length;
 
-    // Step 3: Parse SBE Messages until the end of packet data
-    while (offset < packetData.size()) {
-        SBEHeader header = parseSBEHeader(offset);
         switch (header.template_id) {
             case OrderUpdate::TEMPLATE_ID:
-                orderUpdates.emplace_back(decodeOrderUpdate(offset));
+                if (header.block_length < OrderUpdate::SIZE) {
+                    ++stats.badBlockLengths;
+                    break;
+                }
+                if (!sink.onOrderUpdate(decodeOrderUpdate(offset))) {
+                    return false;
+                }
+                ++stats.messages;
                 break;
             case OrderExecution::TEMPLATE_ID:
-                orderExecutions.emplace_back(decodeOrderExecution(offset));
+                if (header.block_length < OrderExecution::SIZE) {
+                    ++stats.badBlockLengths;
+                    break;
+                }
+                if (!sink.onOrderExecution(decodeOrderExecution(offset))) {
+                    return false;
+                }
+                ++stats.messages;
                 break;
-            case OrderBookSnapshot::TEMPLATE_ID:
-                orderBookSnapshots.emplace_back(
-                  decodeOrderBookSnapshot(offset));
+            case OrderBookSnapshot::TEMPLATE_ID: {
+                // Without a valid root block the group cannot be located,
+                // so nothing after it can be trusted either
+                if (header.block_length < OrderBookSnapshot::BLOCK_LENGTH) {
+                    ++stats.badBlockLengths;
+                    return true;
+                }
+                if (end - next < GroupSize::SIZE) {
+                    ++stats.truncatedMessages;
+                    return true;
+                }
+                OrderBookSnapshot snapshot =
+                  decodeOrderBookSnapshot(offset, header.block_length);
+
+                // The NoMDEntries group is strided by its own block_length
+                const size_t stride = snapshot.no_md_entries.block_length;
+                const size_t length =
+                  stride * snapshot.no_md_entries.num_in_group;
+                next = offset;
+                if (end - next < length) {
+                    ++stats.truncatedMessages;
+                    return true;
+                }
+                next += length;
+                if (length > 0 && stride < OrderBookSnapshot::Entry::SIZE) {
+                    ++stats.badBlockLengths;
+                    break;
+                }
+                if (!sink.onOrderBookSnapshot(
+                      snapshot, packetData + offset, stride)) {
+                    return false;
+                }
+                ++stats.messages;
                 break;
+            }
             default:
                 // Skip unknown messages by advancing the offset by the block
                 // length
-                offset += header.block_length;
+                ++stats.unknownTemplates;
                 break;
         }
+        offset = next;
+    }
+    return true;
+}
+
+// Main decode function that processes the entire packet data
+void SimbaDecoder::decode()
+{
+    VectorSink sink{ orderUpdates, orderExecutions, orderBookSnapshots };
+    walk(sink);
+}
+
+// Decode the packet streaming the messages to the handler
+void SimbaDecoder::decode(MessageHandler& handler)
+{
+    HandlerSink sink{ handler };
+    walk(sink);
+}
+
+// Decode packets one after another into the caller's buffers
+size_t SimbaDecoder::decodeBatch(const PacketView* packets,
+                                 size_t count,
+                                 DecodeBuffers& buffers)
+{
+    buffers.orderUpdatesCount = 0;
+    buffers.orderExecutionsCount = 0;
+    buffers.snapshotEntriesCount = 0;
+
+    size_t decoded = 0;
+    for (; decoded < count; ++decoded) {
+        SimbaDecoder decoder(packets[decoded].data, packets[decoded].size);
+        const uint32_t index = static_cast<uint32_t>(decoded);
+        const char* full = nullptr;
+        if (!decoder.decodeInto(buffers, index, full)) {
+            // The buffers were empty, so no later call can fit this packet
+            if (decoded == 0) {
+                throw std::length_error(
+                  std::string("Error: A packet has more records than the ") +
+                  full + " capacity of the batch.");
+            }
+            break;
+        }
+        buffers.stats += decoder.stats;
     }
+    return decoded;
+}
+
+// Decode this packet's messages straight into flat records
+bool SimbaDecoder::decodeInto(DecodeBuffers& buffers,
+                              uint32_t packetIndex,
+                              const char*& full)
+{
+    const size_t updatesStart = buffers.orderUpdatesCount;
+    const size_t executionsStart = buffers.orderExecutionsCount;
+    const size_t entriesStart = buffers.snapshotEntriesCount;
+
+    BatchSink sink{ buffers,
+                    marketDataPacketHeader,
+                    incrementalPacketHeader,
+                    packetIndex,
+                    nullptr };
+    if (walk(sink)) {
+        return true;
+    }
+    full = sink.full;
+
+    // Restore the counts, the packet is decoded again by the next call
+    buffers.orderUpdatesCount = updatesStart;
+    buffers.orderExecutionsCount = executionsStart;
+    buffers.snapshotEntriesCount = entriesStart;
+    return false;
 }
 
 // Decode OrderUpdate message from the packet data
 OrderUpdate SimbaDecoder::decodeOrderUpdate(size_t& offset) const noexcept
 {
     OrderUpdate update;
-    std::memcpy(&update, &packetData[offset], OrderUpdate::SIZE);
+    std::memcpy(&update, packetData + offset, OrderUpdate::SIZE);
     offset += OrderUpdate::SIZE; // Advance the offset
     return update;
 }
@@ -64,30 +399,28 @@ OrderUpdate SimbaDecoder::decodeOrderUpdate(size_t& offset) const noexcept
 OrderExecution SimbaDecoder::decodeOrderExecution(size_t& offset) const noexcept
 {
     OrderExecution execution;
-    std::memcpy(&execution, &packetData[offset], OrderExecution::SIZE);
+    std::memcpy(&execution, packetData + offset, OrderExecution::SIZE);
     offset += OrderExecution::SIZE; // Advance the offset
     return execution;
 }
 
-// Decode OrderBookSnapshot message from the packet data
-OrderBookSnapshot SimbaDecoder::decodeOrderBookSnapshot(size_t& offset) const
+// Decode the root block and group header of an OrderBookSnapshot message,
+// leaving the offset at the first entry
+OrderBookSnapshot SimbaDecoder::decodeOrderBookSnapshot(
+  size_t& offset,
+  uint16_t blockLength) const noexcept
 {
     OrderBookSnapshot snapshot{};
 
     // Copy the fixed-size portion of the snapshot structure
-    std::memcpy(
-      &snapshot.security_id, &packetData[offset], OrderBookSnapshot::SIZE);
-    offset += OrderBookSnapshot::SIZE; // Advance the offset
-
-    // Resize the vector to hold all entries
-    snapshot.entries.resize(snapshot.no_md_entries.num_in_group);
+    std::memcpy(&snapshot.security_id,
+                packetData + offset,
+                OrderBookSnapshot::BLOCK_LENGTH);
+    offset += blockLength; // Advance the offset past the root block
 
-    // Copy each entry individually
-    for (auto& entry : snapshot.entries) {
-        std::memcpy(
-          &entry, &packetData[offset], OrderBookSnapshot::Entry::SIZE);
-        offset += OrderBookSnapshot::Entry::SIZE; // Advance the offset
-    }
+    std::memcpy(
+      &snapshot.no_md_entries, packetData + offset, GroupSize::SIZE);
+    offset += GroupSize::SIZE; // Advance the offset
 
     return snapshot;
 }
@@ -97,7 +430,7 @@ MarketDataPacketHeader SimbaDecoder::parseMarketDataPacketHeader(
   size_t& offset) const noexcept
 {
     MarketDataPacketHeader header;
-    std::memcpy(&header, &packetData[offset], MarketDataPacketHeader::SIZE);
+    std::memcpy(&header, packetData + offset, MarketDataPacketHeader::SIZE);
     offset += MarketDataPacketHeader::SIZE; // Advance the offset
     return header;
 }
@@ -107,7 +440,7 @@ IncrementalPacketHeader SimbaDecoder::parseIncrementalPacketHeader(
   size_t& offset) const noexcept
 {
     IncrementalPacketHeader header;
-    std::memcpy(&header, &packetData[offset], IncrementalPacketHeader::SIZE);
+    std::memcpy(&header, packetData + offset, IncrementalPacketHeader::SIZE);
     offset += IncrementalPacketHeader::SIZE; // Advance the offset
     return header;
 }
@@ -116,11 +449,96 @@ IncrementalPacketHeader SimbaDecoder::parseIncrementalPacketHeader(
 SBEHeader SimbaDecoder::parseSBEHeader(size_t& offset) const noexcept
 {
     SBEHeader header;
-    std::memcpy(&header, &packetData[offset], SBEHeader::SIZE);
+    std::memcpy(&header, packetData + offset, SBEHeader::SIZE);
     offset += SBEHeader::SIZE; // Advance the offset
     return header;
 }
 
+// Serialize one OrderUpdate as a JSON object
+void SimbaDecoder::writeJSON(std::ostream& json, const OrderUpdate& update)
+{
+    json << "{"
+         << "\"md_entry_id\":" << update.md_entry_id << ","
+         << "\"md_entry_px\":"
+         << update.md_entry_px.mantissa * Decimal5::exponent << ","
+         << "\"md_entry_size\":" << update.md_entry_size << ","
+         << "\"md_flags\":" << static_cast<uint64_t>(update.md_flags) << ","
+         << "\"md_flags2\":" << update.md_flags2 << ","
+         << "\"security_id\":" << update.security_id << ","
+         << "\"rpt_seq\":" << update.rpt_seq << ","
+         << "\"md_update_action\":"
+         << static_cast<int>(update.md_update_action) << ","
+         << "\"md_entry_type\":\""
+         << static_cast<char>(update.md_entry_type) << "\""
+         << "}";
+}
+
+// Serialize one OrderExecution as a JSON object
+void SimbaDecoder::writeJSON(std::ostream& json,
+                             const OrderExecution& execution)
+{
+    json << "{"
+         << "\"md_entry_id\":" << execution.md_entry_id << ","
+         << "\"md_entry_px\":"
+         << (execution.md_entry_px.mantissa != Decimal5NULL::NULL_VALUE
+               ? execution.md_entry_px.mantissa * Decimal5NULL::exponent
+               : 0)
+         << ","
+         << "\"md_entry_size\":" << execution.md_entry_size << ","
+         << "\"last_px\":" << execution.last_px.mantissa * Decimal5::exponent
+         << ","
+         << "\"last_qty\":" << execution.last_qty << ","
+         << "\"trade_id\":" << execution.trade_id << ","
+         << "\"md_flags\":" << static_cast<uint64_t>(execution.md_flags)
+         << ","
+         << "\"md_flags2\":" << execution.md_flags2 << ","
+         << "\"security_id\":" << execution.security_id << ","
+         << "\"rpt_seq\":" << execution.rpt_seq << ","
+         << "\"md_update_action\":"
+         << static_cast<int>(execution.md_update_action) << ","
+         << "\"md_entry_type\":\""
+         << static_cast<char>(execution.md_entry_type) << "\""
+         << "}";
+}
+
+// Serialize one OrderBookSnapshot, including its entries, as a JSON object
+void SimbaDecoder::writeJSON(std::ostream& json,
+                             const OrderBookSnapshot& snapshot)
+{
+    json << "{"
+         << "\"security_id\":" << snapshot.security_id << ","
+         << "\"last_msg_seq_num_processed\":"
+         << snapshot.last_msg_seq_num_processed << ","
+         << "\"rpt_seq\":" << snapshot.rpt_seq << ","
+         << "\"exchange_trading_session_id\":"
+         << snapshot.exchange_trading_session_id << ","
+         << "\"no_md_entries\":{"
+         << "\"block_length\":" << snapshot.no_md_entries.block_length << ","
+         << "\"num_in_group\":"
+         << static_cast<int>(snapshot.no_md_entries.num_in_group) << "},"
+         << "\"entries\":[";
+    for (size_t i = 0; i < snapshot.entries.size(); ++i) {
+        const OrderBookSnapshot::Entry& entry = snapshot.entries[i];
+        json << (i == 0 ? "" : ",") << "{"
+             << "\"md_entry_id\":" << entry.md_entry_id << ","
+             << "\"transact_time\":" << entry.transact_time << ","
+             << "\"md_entry_px\":"
+             << (entry.md_entry_px.mantissa != Decimal5NULL::NULL_VALUE
+                   ? entry.md_entry_px.mantissa * Decimal5NULL::exponent
+                   : 0)
+             << ","
+             << "\"md_entry_size\":" << entry.md_entry_size << ","
+             << "\"trade_id\":" << entry.trade_id << ","
+             << "\"md_flags\":" << static_cast<uint64_t>(entry.md_flags)
+             << ","
+             << "\"md_flags2\":" << entry.md_flags2 << ","
+             << "\"md_entry_type\":\""
+             << static_cast<uint64_t>(entry.md_entry_type) << "\""
+             << "}";
+    }
+    json << "]}";
+}
+
 // Convert the decoded messages into a JSON string
 std::string SimbaDecoder::toJSON() const
 {
@@ -129,96 +547,26 @@ std::string SimbaDecoder::toJSON() const
 
     // Serialize Order Updates
     json << "\"orderUpdates\":[";
-    for (const auto& update : orderUpdates) {
-        json << "{"
-             << "\"md_entry_id\":" << update.md_entry_id << ","
-             << "\"md_entry_px\":"
-             << update.md_entry_px.mantissa * Decimal5::exponent << ","
-             << "\"md_entry_size\":" << update.md_entry_size << ","
-             << "\"md_flags\":" << static_cast<uint64_t>(update.md_flags) << ","
-             << "\"md_flags2\":" << update.md_flags2 << ","
-             << "\"security_id\":" << update.security_id << ","
-             << "\"rpt_seq\":" << update.rpt_seq << ","
-             << "\"md_update_action\":"
-             << static_cast<int>(update.md_update_action) << ","
-             << "\"md_entry_type\":\""
-             << static_cast<char>(update.md_entry_type) << "\""
-             << "},";
+    for (size_t i = 0; i < orderUpdates.size(); ++i) {
+        json << (i == 0 ? "" : ",");
+        writeJSON(json, orderUpdates[i]);
     }
-    if (!orderUpdates.empty())
-        json.seekp(-1, std::ios_base::end);
     json << "],";
 
     // Serialize Order Executions
     json << "\"orderExecutions\":[";
-    for (const auto& execution : orderExecutions) {
-        json << "{"
-             << "\"md_entry_id\":" << execution.md_entry_id << ","
-             << "\"md_entry_px\":"
-             << (execution.md_entry_px.mantissa != Decimal5NULL::NULL_VALUE
-                   ? execution.md_entry_px.mantissa * Decimal5NULL::exponent
-                   : 0)
-             << ","
-             << "\"md_entry_size\":" << execution.md_entry_size << ","
-             << "\"last_px\":"
-             << execution.last_px.mantissa * Decimal5::exponent << ","
-             << "\"last_qty\":" << execution.last_qty << ","
-             << "\"trade_id\":" << execution.trade_id << ","
-             << "\"md_flags\":" << static_cast<uint64_t>(execution.md_flags)
-             << ","
-             << "\"md_flags2\":" << execution.md_flags2 << ","
-             << "\"security_id\":" << execution.security_id << ","
-             << "\"rpt_seq\":" << execution.rpt_seq << ","
-             << "\"md_update_action\":"
-             << static_cast<int>(execution.md_update_action) << ","
-             << "\"md_entry_type\":\""
-             << static_cast<char>(execution.md_entry_type) << "\""
-             << "},";
+    for (size_t i = 0; i < orderExecutions.size(); ++i) {
+        json << (i == 0 ? "" : ",");
+        writeJSON(json, orderExecutions[i]);
     }
-    if (!orderExecutions.empty())
-        json.seekp(-1, std::ios_base::end);
     json << "],";
 
     // Serialize Order Book Snapshots
     json << "\"orderBookSnapshots\":[";
-    for (const auto& snapshot : orderBookSnapshots) {
-        json << "{"
-             << "\"security_id\":" << snapshot.security_id << ","
-             << "\"last_msg_seq_num_processed\":"
-             << snapshot.last_msg_seq_num_processed << ","
-             << "\"rpt_seq\":" << snapshot.rpt_seq << ","
-             << "\"exchange_trading_session_id\":"
-             << snapshot.exchange_trading_session_id << ","
-             << "\"no_md_entries\":{"
-             << "\"block_length\":" << snapshot.no_md_entries.block_length
-             << ","
-             << "\"num_in_group\":"
-             << static_cast<int>(snapshot.no_md_entries.num_in_group) << "},"
-             << "\"entries\":[";
-        for (const auto& entry : snapshot.entries) {
-            json << "{"
-                 << "\"md_entry_id\":" << entry.md_entry_id << ","
-                 << "\"transact_time\":" << entry.transact_time << ","
-                 << "\"md_entry_px\":"
-                 << (entry.md_entry_px.mantissa != Decimal5NULL::NULL_VALUE
-                       ? entry.md_entry_px.mantissa * Decimal5NULL::exponent
-                       : 0)
-                 << ","
-                 << "\"md_entry_size\":" << entry.md_entry_size << ","
-                 << "\"trade_id\":" << entry.trade_id << ","
-                 << "\"md_flags\":" << static_cast<uint64_t>(entry.md_flags)
-                 << ","
-                 << "\"md_flags2\":" << entry.md_flags2 << ","
-                 << "\"md_entry_type\":\""
-                 << static_cast<uint64_t>(entry.md_entry_type) << "\""
-                 << "},";
-        }
-        if (!snapshot.entries.empty())
-            json.seekp(-1, std::ios_base::end);
-        json << "]},";
+    for (size_t i = 0; i < orderBookSnapshots.size(); ++i) {
+        json << (i == 0 ? "" : ",");
+        writeJSON(json, orderBookSnapshots[i]);
     }
-    if (!orderBookSnapshots.empty())
-        json.seekp(-1, std::ios_base::end);
     json << "]";
 
     json << "}";
@@ -0,0 +1,1151 @@
+#include "../include/time_series_store.hpp"
+#include "../include/bar_aggregator.hpp"
+#include "../include/pcap_parser.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>    // For open
+#include <sys/mman.h> // For mmap
+#include <sys/stat.h> // For mkdir, stat and fstat
+#include <unistd.h>   // For close
+
+namespace simba {
+
+namespace {
+
+// Rows buffered by the builder before partitions are written out
+constexpr size_t MAX_PENDING_ROWS = 16 * 1024 * 1024;
+
+enum class Field
+{
+    SecurityId,
+    Time,
+    Price,
+    Quantity,
+    TradeId,
+    Side,
+};
+
+const struct
+{
+    const char* name;
+    Field field;
+} FIELDS[] = {
+    { "security_id", Field::SecurityId },
+    { "time", Field::Time },
+    { "price", Field::Price },
+    { "qty", Field::Quantity },
+    { "trade_id", Field::TradeId },
+    { "side", Field::Side },
+};
+
+const struct
+{
+    const char* name;
+    Aggregation aggregation;
+} AGGREGATIONS[] = {
+    { "count", Aggregation::Count },
+    { "sum(qty)", Aggregation::SumQty },
+    { "min(price)", Aggregation::MinPrice },
+    { "max(price)", Aggregation::MaxPrice },
+    { "first(price)", Aggregation::FirstPrice },
+    { "last(price)", Aggregation::LastPrice },
+    { "vwap", Aggregation::Vwap },
+    { "min(time)", Aggregation::MinTime },
+    { "max(time)", Aggregation::MaxTime },
+};
+
+const char* aggregationName(Aggregation aggregation)
+{
+    for (const auto& entry : AGGREGATIONS) {
+        if (entry.aggregation == aggregation) {
+            return entry.name;
+        }
+    }
+    return "";
+}
+
+std::string manifestPath(const std::string& directory)
+{
+    return directory + "/manifest.bin";
+}
+
+std::string partitionPath(const std::string& directory, uint64_t start)
+{
+    return directory + "/partition_" + std::to_string(start) + ".bin";
+}
+
+std::string lower(std::string text)
+{
+    for (char& c : text) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return text;
+}
+
+// Intersect a range with [low, high]
+void narrow(FieldRange& range, int64_t low, int64_t high)
+{
+    range.low = std::max(range.low, low);
+    range.high = std::min(range.high, high);
+}
+
+// Parse a whole token as a signed integer
+bool parseInteger(const std::string& token, int64_t& value)
+{
+    if (token.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoll(token.c_str(), &end, 10);
+    return errno == 0 && *end == '\0';
+}
+
+// Parse a decimal such as "-123.45" into a Decimal5 mantissa
+int64_t parsePrice(const std::string& token)
+{
+    const size_t dot = token.find('.');
+    std::string digits = token.substr(0, dot);
+    std::string fraction =
+      dot == std::string::npos ? std::string() : token.substr(dot + 1);
+    if (fraction.size() > 5 ||
+        fraction.find_first_not_of("0123456789") != std::string::npos) {
+        throw std::runtime_error("Error: Invalid price in query: " + token);
+    }
+    fraction.append(5 - fraction.size(), '0');
+    if (digits.empty() || digits == "-") {
+        digits += "0";
+    }
+
+    int64_t value = 0;
+    if (!parseInteger(digits + fraction, value)) {
+        throw std::runtime_error("Error: Invalid price in query: " + token);
+    }
+    return value;
+}
+
+// Parse nanoseconds or UTC "YYYY-MM-DD[THH:MM:SS[.fraction]]"
+int64_t parseTime(const std::string& token)
+{
+    int64_t value = 0;
+    if (parseInteger(token, value)) {
+        return value;
+    }
+
+    std::tm tm{};
+    int consumed = 0;
+    if (std::sscanf(token.c_str(),
+                    "%4d-%2d-%2d%n",
+                    &tm.tm_year,
+                    &tm.tm_mon,
+                    &tm.tm_mday,
+                    &consumed) != 3) {
+        throw std::runtime_error("Error: Invalid time in query: " + token);
+    }
+    size_t position = consumed;
+    if (position < token.size()) {
+        if (std::sscanf(token.c_str() + position,
+                        "T%2d:%2d:%2d%n",
+                        &tm.tm_hour,
+                        &tm.tm_min,
+                        &tm.tm_sec,
+                        &consumed) != 3) {
+            throw std::runtime_error("Error: Invalid time in query: " + token);
+        }
+        position += consumed;
+    }
+
+    int64_t fraction = 0;
+    if (position < token.size()) {
+        std::string digits = token.substr(position + 1);
+        if (token[position] != '.' || digits.empty() || digits.size() > 9 ||
+            digits.find_first_not_of("0123456789") != std::string::npos) {
+            throw std::runtime_error("Error: Invalid time in query: " + token);
+        }
+        digits.append(9 - digits.size(), '0');
+        fraction = std::strtoll(digits.c_str(), nullptr, 10);
+    }
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    return static_cast<int64_t>(timegm(&tm)) * 1000000000 + fraction;
+}
+
+// Split a query into words, commas, parentheses and comparison operators
+std::vector<std::string> tokenize(const std::string& text)
+{
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    while (i < text.size()) {
+        const char c = text[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++i;
+        } else if (c == ',' || c == '(' || c == ')') {
+            tokens.emplace_back(1, c);
+            ++i;
+        } else if (c == '<' || c == '>' || c == '=') {
+            const size_t length = (c != '=' && i + 1 < text.size() &&
+                                   text[i + 1] == '=')
+                                    ? 2
+                                    : 1;
+            tokens.push_back(text.substr(i, length));
+            i += length;
+        } else {
+            const size_t end = text.find_first_of(" \t\r\n,()<>=", i);
+            tokens.push_back(text.substr(i, end - i));
+            i = end == std::string::npos ? text.size() : end;
+        }
+    }
+    return tokens;
+}
+
+// Recursive descent parser of the Query grammar
+class QueryParser
+{
+public:
+    explicit QueryParser(const std::string& text)
+      : tokens(tokenize(text))
+      , position(0)
+    {
+    }
+
+    Query parse()
+    {
+        Query query;
+        const std::string table = lower(next("a message type"));
+        if (table == "executions") {
+            query.templateId = OrderExecution::TEMPLATE_ID;
+        } else if (table == "updates") {
+            query.templateId = OrderUpdate::TEMPLATE_ID;
+        } else if (table != "messages") {
+            throw std::runtime_error(
+              "Error: Query must start with executions, updates or messages.");
+        }
+
+        while (position < tokens.size()) {
+            if (accept("where")) {
+                do {
+                    parseCondition(query);
+                } while (accept("and"));
+            } else if (accept("select")) {
+                do {
+                    query.aggregations.push_back(parseAggregation());
+                } while (accept(","));
+            } else if (accept("by")) {
+                expect("security_id");
+                query.bySecurity = true;
+            } else if (accept("limit")) {
+                int64_t limit = 0;
+                if (!parseInteger(next("a limit"), limit) || limit < 0) {
+                    throw std::runtime_error("Error: Invalid query limit.");
+                }
+                query.limit = static_cast<uint64_t>(limit);
+            } else {
+                throw std::runtime_error("Error: Unexpected '" +
+                                         tokens[position] + "' in query.");
+            }
+        }
+
+        if (query.bySecurity && query.aggregations.empty()) {
+            query.aggregations.push_back(Aggregation::Count);
+        }
+        return query;
+    }
+
+private:
+    std::vector<std::string> tokens;
+    size_t position;
+
+    const std::string& next(const char* expected)
+    {
+        if (position >= tokens.size()) {
+            throw std::runtime_error(std::string("Error: Query expected ") +
+                                     expected + ".");
+        }
+        return tokens[position++];
+    }
+
+    bool accept(const char* keyword)
+    {
+        if (position < tokens.size() && lower(tokens[position]) == keyword) {
+            ++position;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(const char* keyword)
+    {
+        if (!accept(keyword)) {
+            throw std::runtime_error(std::string("Error: Query expected '") +
+                                     keyword + "'.");
+        }
+    }
+
+    int64_t parseValue(Field field)
+    {
+        const std::string& token = next("a value");
+        int64_t value = 0;
+        if (field == Field::Time) {
+            value = parseTime(token);
+        } else if (field == Field::Price) {
+            value = parsePrice(token);
+        } else if (!parseInteger(token, value)) {
+            throw std::runtime_error("Error: Invalid number in query: " +
+                                     token);
+        }
+        return value;
+    }
+
+    void parseCondition(Query& query)
+    {
+        const std::string name = lower(next("a field"));
+        const Field* field = nullptr;
+        for (const auto& entry : FIELDS) {
+            if (name == entry.name) {
+                field = &entry.field;
+            }
+        }
+        if (field == nullptr) {
+            throw std::runtime_error("Error: Unknown field in query: " + name);
+        }
+
+        if (*field == Field::Side) {
+            expect("=");
+            const std::string side = lower(next("bid or offer"));
+            if (side == "bid") {
+                query.side = static_cast<char>(MDEntryType::Bid);
+            } else if (side == "offer") {
+                query.side = static_cast<char>(MDEntryType::Offer);
+            } else {
+                throw std::runtime_error("Error: Side must be bid or offer.");
+            }
+            return;
+        }
+
+        FieldRange* range = nullptr;
+        switch (*field) {
+            case Field::SecurityId:
+                range = &query.securityId;
+                break;
+            case Field::Time:
+                range = &query.time;
+                break;
+            case Field::Price:
+                range = &query.price;
+                break;
+            case Field::Quantity:
+                range = &query.quantity;
+                break;
+            default:
+                range = &query.tradeId;
+                break;
+        }
+
+        if (accept("between")) {
+            const int64_t low = parseValue(*field);
+            expect("and");
+            narrow(*range, low, parseValue(*field));
+            return;
+        }
+
+        const std::string op = next("a comparison");
+        const int64_t value = parseValue(*field);
+        if (op == "=") {
+            narrow(*range, value, value);
+        } else if (op == "<=") {
+            narrow(*range, INT64_MIN, value);
+        } else if (op == ">=") {
+            narrow(*range, value, INT64_MAX);
+        } else if (op == "<") {
+            if (value == INT64_MIN) {
+                narrow(*range, 1, 0); // Matches nothing
+            } else {
+                narrow(*range, INT64_MIN, value - 1);
+            }
+        } else if (op == ">") {
+            if (value == INT64_MAX) {
+                narrow(*range, 1, 0);
+            } else {
+                narrow(*range, value + 1, INT64_MAX);
+            }
+        } else {
+            throw std::runtime_error("Error: Unknown comparison in query: " +
+                                     op);
+        }
+    }
+
+    Aggregation parseAggregation()
+    {
+        std::string name = lower(next("an aggregate"));
+        if (accept("(")) {
+            name += "(" + lower(next("a field")) + ")";
+            expect(")");
+        }
+        for (const auto& entry : AGGREGATIONS) {
+            if (name == entry.name) {
+                return entry.aggregation;
+            }
+        }
+        throw std::runtime_error("Error: Unknown aggregate in query: " + name);
+    }
+};
+
+// Read a whole file of packed records, used when merging into a partition
+void readExact(std::ifstream& file, void* data, size_t size)
+{
+    file.read(static_cast<char*>(data), size);
+    if (!file) {
+        throw std::runtime_error("Error reading store file.");
+    }
+}
+
+// Replace path by the temporary file once it is complete
+void commit(std::ofstream& file,
+            const std::string& temporaryPath,
+            const std::string& path)
+{
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Error writing store file " + temporaryPath);
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Error: Could not replace store file " +
+                                 path);
+    }
+}
+
+// Collects the order updates and executions of a packet as rows, in wire
+// order. The packet level fields are filled in by the caller.
+class RowCollector : public MessageHandler
+{
+public:
+    std::vector<StoredMessage> rows;
+
+    void onOrderUpdate(const OrderUpdate& update) override
+    {
+        rows.emplace_back();
+        StoredMessage& row = rows.back();
+        row.security_id = update.security_id;
+        row.template_id = OrderUpdate::TEMPLATE_ID;
+        row.md_update_action = static_cast<uint8_t>(update.md_update_action);
+        row.md_entry_type = static_cast<char>(update.md_entry_type);
+        row.md_entry_id = update.md_entry_id;
+        row.price = update.md_entry_px.mantissa;
+        row.quantity = update.md_entry_size;
+        row.trade_id = 0;
+        row.md_flags = static_cast<uint64_t>(update.md_flags);
+        row.rpt_seq = update.rpt_seq;
+    }
+
+    void onOrderExecution(const OrderExecution& execution) override
+    {
+        rows.emplace_back();
+        StoredMessage& row = rows.back();
+        row.security_id = execution.security_id;
+        row.template_id = OrderExecution::TEMPLATE_ID;
+        row.md_update_action =
+          static_cast<uint8_t>(execution.md_update_action);
+        row.md_entry_type = static_cast<char>(execution.md_entry_type);
+        row.md_entry_id = execution.md_entry_id;
+        row.price = execution.last_px.mantissa;
+        row.quantity = execution.last_qty;
+        row.trade_id = execution.trade_id;
+        row.md_flags = static_cast<uint64_t>(execution.md_flags);
+        row.rpt_seq = execution.rpt_seq;
+    }
+
+    void onOrderBookSnapshot(const OrderBookSnapshot&) override {}
+};
+
+// Load the zone maps and the ingested captures of a store, returns false if
+// it has no manifest yet
+bool readManifest(const std::string& directory,
+                  uint64_t& partitionNs,
+                  std::vector<ZoneMap>& zones,
+                  std::vector<IngestedCapture>& captures)
+{
+    std::ifstream file(manifestPath(directory), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    StoreFileHeader header;
+    readExact(file, &header, StoreFileHeader::SIZE);
+    if (header.magic != StoreFileHeader::MANIFEST_MAGIC) {
+        throw std::runtime_error("Error: Not a store manifest: " +
+                                 manifestPath(directory));
+    }
+    partitionNs = header.partition_ns;
+    zones.resize(header.count);
+    readExact(file, zones.data(), zones.size() * ZoneMap::SIZE);
+
+    uint64_t captureCount = 0;
+    readExact(file, &captureCount, sizeof(captureCount));
+    captures.resize(captureCount);
+    readExact(file, captures.data(), captures.size() * IngestedCapture::SIZE);
+    return true;
+}
+
+// Start the identity of a capture whose global header the parser has read
+IngestedCapture startCapture(const std::string& path,
+                             const pcap::PcapParser& parser)
+{
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) {
+        throw std::runtime_error("Error: Could not stat pcap file " + path);
+    }
+    IngestedCapture capture{ static_cast<uint64_t>(info.st_size),
+                             0xcbf29ce484222325ULL };
+    capture.add(&parser.getGlobalHeader(), pcap::PcapGlobalHeader::SIZE);
+    return capture;
+}
+
+// Fold the record header and the payload of a packet into a capture's hash
+void addPacket(IngestedCapture& capture, const pcap::PcapPacket& packet)
+{
+    capture.add(&packet.header, pcap::PcapPacketHeader::SIZE);
+    capture.add(packet.data.data(), packet.data.size());
+}
+
+} // namespace
+
+// Hash the whole capture, it is read sequentially in large blocks
+void IngestedCapture::add(const void* data, size_t length) noexcept
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+// Check a row against every filter of the query
+bool Query::matches(const StoredMessage& row) const noexcept
+{
+    return (templateId == 0 || row.template_id == templateId) &&
+           securityId.contains(row.security_id) &&
+           row.time <= static_cast<uint64_t>(INT64_MAX) &&
+           time.contains(static_cast<int64_t>(row.time)) &&
+           price.contains(row.price) && quantity.contains(row.quantity) &&
+           tradeId.contains(row.trade_id) &&
+           (side == 0 || row.md_entry_type == side);
+}
+
+Query Query::parse(const std::string& text)
+{
+    return QueryParser(text).parse();
+}
+
+void QueryAggregate::add(const StoredMessage& row) noexcept
+{
+    ++count;
+    sumQty = saturatingAdd(sumQty, row.quantity);
+    notional =
+      saturatingAdd(notional, static_cast<Notional>(row.price) * row.quantity);
+    minPrice = std::min(minPrice, row.price);
+    maxPrice = std::max(maxPrice, row.price);
+    if (row.time < firstTime) {
+        firstTime = row.time;
+        firstPrice = row.price;
+    }
+    if (row.time >= lastTime) {
+        lastTime = row.time;
+        lastPrice = row.price;
+    }
+}
+
+// Merge the aggregate of a later partition
+void QueryAggregate::merge(const QueryAggregate& other) noexcept
+{
+    if (other.count == 0) {
+        return;
+    }
+    count += other.count;
+    sumQty = saturatingAdd(sumQty, other.sumQty);
+    notional = saturatingAdd(notional, other.notional);
+    minPrice = std::min(minPrice, other.minPrice);
+    maxPrice = std::max(maxPrice, other.maxPrice);
+    if (other.firstTime < firstTime) {
+        firstTime = other.firstTime;
+        firstPrice = other.firstPrice;
+    }
+    if (other.lastTime >= lastTime) {
+        lastTime = other.lastTime;
+        lastPrice = other.lastPrice;
+    }
+}
+
+// Write rows or aggregates as CSV
+void QueryResult::write(std::ostream& out, const Query& query) const
+{
+    if (query.aggregations.empty()) {
+        out << "time,security_id,type,md_entry_id,price,qty,trade_id,"
+               "md_entry_type,md_update_action,md_flags,msg_seq_num,rpt_seq\n";
+        const size_t count =
+          std::min<uint64_t>(rows.size(), query.limit);
+        for (size_t i = 0; i < count; ++i) {
+            const StoredMessage& row = rows[i];
+            out << row.time << ',' << row.security_id << ','
+                << (row.template_id == OrderExecution::TEMPLATE_ID
+                      ? "execution"
+                      : "update")
+                << ',' << row.md_entry_id << ',' << formatDecimal5(row.price)
+                << ',' << row.quantity << ',' << row.trade_id << ','
+                << row.md_entry_type << ','
+                << static_cast<int>(row.md_update_action) << ','
+                << row.md_flags << ',' << row.msg_seq_num << ','
+                << row.rpt_seq << '\n';
+        }
+        return;
+    }
+
+    if (query.bySecurity) {
+        out << "security_id,";
+    }
+    for (size_t i = 0; i < query.aggregations.size(); ++i) {
+        out << (i > 0 ? "," : "") << aggregationName(query.aggregations[i]);
+    }
+    out << '\n';
+
+    // Without grouping there is always exactly one line, even if empty
+    std::map<int32_t, QueryAggregate> groups = bySecurity;
+    if (!query.bySecurity && groups.empty()) {
+        groups[0] = QueryAggregate();
+    }
+
+    uint64_t written = 0;
+    for (const auto& group : groups) {
+        if (written++ == query.limit) {
+            break;
+        }
+        const QueryAggregate& aggregate = group.second;
+        if (query.bySecurity) {
+            out << group.first << ',';
+        }
+        for (size_t i = 0; i < query.aggregations.size(); ++i) {
+            if (i > 0) {
+                out << ',';
+            }
+            const Aggregation aggregation = query.aggregations[i];
+            if (aggregation == Aggregation::Count) {
+                out << aggregate.count;
+                continue;
+            }
+            if (aggregate.count == 0) {
+                continue; // Undefined without rows, left empty
+            }
+            switch (aggregation) {
+                case Aggregation::SumQty:
+                    out << aggregate.sumQty;
+                    break;
+                case Aggregation::MinPrice:
+                    out << formatDecimal5(aggregate.minPrice);
+                    break;
+                case Aggregation::MaxPrice:
+                    out << formatDecimal5(aggregate.maxPrice);
+                    break;
+                case Aggregation::FirstPrice:
+                    out << formatDecimal5(aggregate.firstPrice);
+                    break;
+                case Aggregation::LastPrice:
+                    out << formatDecimal5(aggregate.lastPrice);
+                    break;
+                case Aggregation::Vwap:
+                    out << formatDecimal5(
+                      vwap(aggregate.notional, aggregate.sumQty));
+                    break;
+                case Aggregation::MinTime:
+                    out << aggregate.firstTime;
+                    break;
+                case Aggregation::MaxTime:
+                    out << aggregate.lastTime;
+                    break;
+                default:
+                    break;
+            }
+        }
+        out << '\n';
+    }
+}
+
+// Constructor creates the store directory and picks up its partitions
+StoreBuilder::StoreBuilder(const std::string& directory, uint64_t partitionNs)
+  : directory(directory)
+  , partitionNs(partitionNs)
+  , pendingRows(0)
+{
+    if (partitionNs == 0) {
+        throw std::runtime_error("Error: Partition length must be positive.");
+    }
+    if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Error: Could not create store directory " +
+                                 directory + ": " + std::strerror(errno));
+    }
+
+    uint64_t existingNs = 0;
+    std::vector<ZoneMap> zones;
+    if (readManifest(directory, existingNs, zones, captures)) {
+        if (existingNs != partitionNs) {
+            throw std::runtime_error(
+              "Error: The store uses a different partition length.");
+        }
+        for (const auto& zone : zones) {
+            partitions[zone.start_time] = zone;
+        }
+    }
+}
+
+// Bucket the decoded messages by partition of their transact time
+bool StoreBuilder::addCapture(const std::string& pcapFile)
+{
+    pcap::PcapParser parser(pcapFile);
+    parser.open();
+    IngestedCapture capture = startCapture(pcapFile, parser);
+
+    // Only a capture of a size already merged can be a repeat, and only then
+    // is it hashed ahead of the decode pass
+    pcap::PcapPacket packet;
+    const bool hashed = std::any_of(
+      captures.begin(),
+      captures.end(),
+      [&capture](const IngestedCapture& c) { return c.size == capture.size; });
+    if (hashed) {
+        while (parser.next(packet)) {
+            addPacket(capture, packet);
+        }
+        if (std::find(captures.begin(), captures.end(), capture) !=
+            captures.end()) {
+            return false;
+        }
+        parser.seek(pcap::PcapGlobalHeader::SIZE);
+    }
+
+    RowCollector collector;
+    while (parser.next(packet)) {
+        if (!hashed) {
+            addPacket(capture, packet);
+        }
+        collector.rows.clear();
+        SimbaDecoder decoder(packet.data);
+        decoder.decode(collector);
+        stats += decoder.getStats();
+        if (collector.rows.empty()) {
+            continue;
+        }
+
+        const uint64_t time = decoder.getTransactTime();
+        const uint32_t sequence = decoder.getPacketHeader().msg_seq_num;
+        std::vector<StoredMessage>& rows = pending[time - time % partitionNs];
+        for (StoredMessage& row : collector.rows) {
+            row.time = time;
+            row.msg_seq_num = sequence;
+            rows.push_back(row);
+        }
+        pendingRows += collector.rows.size();
+
+        if (pendingRows >= MAX_PENDING_ROWS) {
+            flush();
+        }
+    }
+    captures.push_back(capture);
+    return true;
+}
+
+void StoreBuilder::finish()
+{
+    flush();
+}
+
+// Write the pending partitions, then the manifest describing all of them
+void StoreBuilder::flush()
+{
+    for (auto& entry : pending) {
+        writePartition(entry.first, entry.second);
+    }
+    pending.clear();
+    pendingRows = 0;
+
+    const std::string path = manifestPath(directory);
+    const std::string temporaryPath = path + ".tmp";
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Error: Could not open store manifest.");
+    }
+
+    StoreFileHeader header;
+    header.magic = StoreFileHeader::MANIFEST_MAGIC;
+    header.partition_ns = partitionNs;
+    header.count = partitions.size();
+    file.write(reinterpret_cast<const char*>(&header), StoreFileHeader::SIZE);
+    for (const auto& entry : partitions) {
+        file.write(reinterpret_cast<const char*>(&entry.second), ZoneMap::SIZE);
+    }
+    const uint64_t captureCount = captures.size();
+    file.write(reinterpret_cast<const char*>(&captureCount),
+               sizeof(captureCount));
+    file.write(reinterpret_cast<const char*>(captures.data()),
+               captures.size() * IngestedCapture::SIZE);
+    commit(file, temporaryPath, path);
+}
+
+// Sort a partition by security_id and time, merging it with the rows already
+// stored for the same interval, and write it with its zone map and directory
+void StoreBuilder::writePartition(uint64_t start,
+                                  std::vector<StoredMessage>& rows)
+{
+    const std::string path = partitionPath(directory, start);
+    if (partitions.count(start) != 0) {
+        std::ifstream existing(path, std::ios::binary);
+        if (!existing) {
+            throw std::runtime_error("Error: Could not open store partition " +
+                                     path);
+        }
+        StoreFileHeader header;
+        ZoneMap zone;
+        readExact(existing, &header, StoreFileHeader::SIZE);
+        readExact(existing, &zone, ZoneMap::SIZE);
+        existing.seekg(zone.security_count * SecurityRange::SIZE,
+                       std::ios::cur);
+
+        std::vector<StoredMessage> merged(zone.row_count);
+        readExact(existing, merged.data(), merged.size() * StoredMessage::SIZE);
+        merged.insert(merged.end(), rows.begin(), rows.end());
+        rows.swap(merged);
+    }
+
+    // Stable, so messages of one security and time keep their wire order
+    std::stable_sort(rows.begin(),
+                     rows.end(),
+                     [](const StoredMessage& a, const StoredMessage& b) {
+                         return a.security_id != b.security_id
+                                  ? a.security_id < b.security_id
+                                  : a.time < b.time;
+                     });
+
+    ZoneMap zone{};
+    zone.start_time = start;
+    zone.row_count = rows.size();
+    zone.min_security_id = rows.front().security_id;
+    zone.max_security_id = rows.back().security_id;
+    zone.min_time = UINT64_MAX;
+    zone.min_price = INT64_MAX;
+    zone.max_price = INT64_MIN;
+
+    std::vector<SecurityRange> ranges;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const StoredMessage& row = rows[i];
+        if (ranges.empty() || ranges.back().security_id != row.security_id) {
+            ranges.push_back(SecurityRange{ row.security_id, i, 0 });
+        }
+        ++ranges.back().row_count;
+        zone.min_time = std::min<uint64_t>(zone.min_time, row.time);
+        zone.max_time = std::max<uint64_t>(zone.max_time, row.time);
+        zone.min_price = std::min<int64_t>(zone.min_price, row.price);
+        zone.max_price = std::max<int64_t>(zone.max_price, row.price);
+        if (row.template_id == OrderExecution::TEMPLATE_ID) {
+            ++zone.execution_count;
+        }
+    }
+    zone.security_count = static_cast<uint32_t>(ranges.size());
+
+    const std::string temporaryPath = path + ".tmp";
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Error: Could not open store partition " +
+                                 temporaryPath);
+    }
+
+    StoreFileHeader header;
+    header.magic = StoreFileHeader::PARTITION_MAGIC;
+    header.partition_ns = partitionNs;
+    header.count = 1;
+    file.write(reinterpret_cast<const char*>(&header), StoreFileHeader::SIZE);
+    file.write(reinterpret_cast<const char*>(&zone), ZoneMap::SIZE);
+    file.write(reinterpret_cast<const char*>(ranges.data()),
+               ranges.size() * SecurityRange::SIZE);
+    file.write(reinterpret_cast<const char*>(rows.data()),
+               rows.size() * StoredMessage::SIZE);
+    commit(file, temporaryPath, path);
+
+    partitions[start] = zone;
+    std::vector<StoredMessage>().swap(rows);
+}
+
+// Constructor maps every partition listed in the manifest
+TimeSeriesStore::TimeSeriesStore(const std::string& directory)
+{
+    uint64_t partitionNs = 0;
+    std::vector<ZoneMap> zones;
+    std::vector<IngestedCapture> captures;
+    if (!readManifest(directory, partitionNs, zones, captures)) {
+        throw std::runtime_error("Error: Could not open store manifest in " +
+                                 directory);
+    }
+
+    partitions.resize(zones.size());
+    for (size_t i = 0; i < zones.size(); ++i) {
+        partitions[i].zone = zones[i];
+        partitions[i].path = partitionPath(directory, zones[i].start_time);
+        map(partitions[i]);
+    }
+}
+
+TimeSeriesStore::~TimeSeriesStore()
+{
+    for (auto& partition : partitions) {
+        if (partition.mapping != nullptr) {
+            ::munmap(const_cast<uint8_t*>(partition.mapping),
+                     partition.mappingSize);
+        }
+    }
+}
+
+// Memory-map a partition file and check it against its zone map
+void TimeSeriesStore::map(Partition& partition)
+{
+    const int fd = ::open(partition.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Error: Could not open store partition " +
+                                 partition.path + ": " + std::strerror(errno));
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Error: Could not stat store partition " +
+                                 partition.path);
+    }
+
+    const ZoneMap& zone = partition.zone;
+    const size_t dataOffset = StoreFileHeader::SIZE + ZoneMap::SIZE;
+    const size_t expectedSize = dataOffset +
+                                zone.security_count * SecurityRange::SIZE +
+                                zone.row_count * StoredMessage::SIZE;
+    if (static_cast<size_t>(info.st_size) != expectedSize) {
+        ::close(fd);
+        throw std::runtime_error("Error: Store partition " + partition.path +
+                                 " does not match the manifest.");
+    }
+
+    void* mapping =
+      ::mmap(nullptr, expectedSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Error: Could not map store partition " +
+                                 partition.path + ": " + std::strerror(errno));
+    }
+
+    const StoreFileHeader* header =
+      static_cast<const StoreFileHeader*>(mapping);
+    if (header->magic != StoreFileHeader::PARTITION_MAGIC) {
+        ::munmap(mapping, expectedSize);
+        throw std::runtime_error("Error: Not a store partition: " +
+                                 partition.path);
+    }
+
+    partition.mapping = static_cast<const uint8_t*>(mapping);
+    partition.mappingSize = expectedSize;
+    partition.ranges =
+      reinterpret_cast<const SecurityRange*>(partition.mapping + dataOffset);
+    partition.rows = reinterpret_cast<const StoredMessage*>(
+      partition.mapping + dataOffset +
+      zone.security_count * SecurityRange::SIZE);
+}
+
+// Scan the partitions whose zone maps overlap the query, one thread per
+// partition at a time, and merge the partial results in time order up to
+// the limit
+QueryResult TimeSeriesStore::run(const Query& query, unsigned threads)
+{
+    // Times are unsigned on disk, the query range is clamped to match
+    const uint64_t timeLow = std::max<int64_t>(query.time.low, 0);
+    const uint64_t timeHigh = query.time.high;
+    std::vector<const Partition*> candidates;
+    for (const auto& partition : partitions) {
+        const ZoneMap& zone = partition.zone;
+        const bool hasType =
+          query.templateId == 0 ||
+          (query.templateId == OrderExecution::TEMPLATE_ID
+             ? zone.execution_count > 0
+             : zone.execution_count < zone.row_count);
+        if (hasType && query.time.high >= 0 && zone.min_time <= timeHigh &&
+            zone.max_time >= timeLow &&
+            query.securityId.overlaps(zone.min_security_id,
+                                      zone.max_security_id) &&
+            query.price.overlaps(zone.min_price, zone.max_price)) {
+            candidates.push_back(&partition);
+        }
+    }
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min<size_t>(threads, candidates.size());
+
+    // Partitions cover disjoint intervals in time order, so once the ones
+    // before an index hold limit rows, the rest are not scanned
+    std::vector<QueryResult> partial(candidates.size());
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> cutoff(candidates.size());
+    std::atomic<size_t> scanned(0);
+    std::mutex mutex;
+    std::vector<bool> done(candidates.size(), false);
+    size_t donePrefix = 0; // Partitions before it are all scanned
+    uint64_t prefixRows = 0;
+    auto worker = [&]() {
+        for (size_t i = next++; i < cutoff; i = next++) {
+            scan(*candidates[i], query, partial[i]);
+            ++scanned;
+            if (!query.aggregations.empty()) {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            done[i] = true;
+            while (donePrefix < done.size() && done[donePrefix]) {
+                prefixRows += partial[donePrefix++].rows.size();
+            }
+            if (prefixRows >= query.limit && donePrefix < cutoff) {
+                cutoff = donePrefix;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    QueryResult result;
+    result.partitionsScanned = scanned;
+    result.partitionsTotal = partitions.size();
+    for (size_t i = 0; i < cutoff; ++i) {
+        const std::vector<StoredMessage>& rows = partial[i].rows;
+        const size_t count =
+          std::min<uint64_t>(rows.size(), query.limit - result.rows.size());
+        result.rows.insert(
+          result.rows.end(), rows.begin(), rows.begin() + count);
+        for (const auto& group : partial[i].bySecurity) {
+            result.bySecurity[group.first].merge(group.second);
+        }
+    }
+    return result;
+}
+
+// Binary search the securities and, within each, the time range, then filter
+// the remaining rows. Rows are merged across securities in time order and
+// stop at the limit.
+void TimeSeriesStore::scan(const Partition& partition,
+                           const Query& query,
+                           QueryResult& result) const
+{
+    const uint64_t timeLow = std::max<int64_t>(query.time.low, 0);
+    const uint64_t timeHigh = query.time.high;
+    const SecurityRange* rangesEnd =
+      partition.ranges + partition.zone.security_count;
+    const SecurityRange* range = std::lower_bound(
+      partition.ranges,
+      rangesEnd,
+      query.securityId.low,
+      [](const SecurityRange& r, int64_t id) { return r.security_id < id; });
+
+    // Rows of each security within the time range, in security_id order
+    struct Span
+    {
+        const StoredMessage* row;
+        const StoredMessage* end;
+    };
+    std::vector<Span> spans;
+    for (; range != rangesEnd && range->security_id <= query.securityId.high;
+         ++range) {
+        const StoredMessage* rowsBegin = partition.rows + range->first_row;
+        const StoredMessage* rowsEnd = rowsBegin + range->row_count;
+        const StoredMessage* row = std::lower_bound(
+          rowsBegin,
+          rowsEnd,
+          timeLow,
+          [](const StoredMessage& r, uint64_t t) { return r.time < t; });
+        const StoredMessage* last = std::upper_bound(
+          row,
+          rowsEnd,
+          timeHigh,
+          [](uint64_t t, const StoredMessage& r) { return t < r.time; });
+        if (row != last) {
+            spans.push_back(Span{ row, last });
+        }
+    }
+
+    if (!query.aggregations.empty()) {
+        for (const Span& span : spans) {
+            QueryAggregate* aggregate = nullptr;
+            int64_t lastTradeId = INT64_MIN;
+            for (const StoredMessage* row = span.row; row != span.end; ++row) {
+                if (!query.matches(*row)) {
+                    continue;
+                }
+                // Both sides of a trade are stored as executions with the
+                // same trade_id, and trade ids increase monotonically, so
+                // count each once as the bar aggregator does
+                if (row->template_id == OrderExecution::TEMPLATE_ID) {
+                    if (row->trade_id <= lastTradeId) {
+                        continue;
+                    }
+                    lastTradeId = row->trade_id;
+                }
+                if (aggregate == nullptr) {
+                    aggregate =
+                      &result.bySecurity[query.bySecurity ? row->security_id
+                                                          : 0];
+                }
+                aggregate->add(*row);
+            }
+        }
+        return;
+    }
+
+    // Skip to the next matching row of a span, false once it is exhausted
+    auto seek = [&query](Span& span) {
+        while (span.row != span.end && !query.matches(*span.row)) {
+            ++span.row;
+        }
+        return span.row != span.end;
+    };
+
+    // Min-heap of (time, span) so that equal times keep security_id order
+    typedef std::pair<uint64_t, size_t> Head;
+    const std::greater<Head> later;
+    std::vector<Head> heads;
+    for (size_t i = 0; i < spans.size(); ++i) {
+        if (seek(spans[i])) {
+            heads.emplace_back(spans[i].row->time, i);
+        }
+    }
+    std::make_heap(heads.begin(), heads.end(), later);
+    while (!heads.empty() && result.rows.size() < query.limit) {
+        std::pop_heap(heads.begin(), heads.end(), later);
+        Span& span = spans[heads.back().second];
+        result.rows.push_back(*span.row++);
+        if (seek(span)) {
+            heads.back().first = span.row->time;
+            std::push_heap(heads.begin(), heads.end(), later);
+        } else {
+            heads.pop_back();
+        }
+    }
+}
+
+} // namespace simba